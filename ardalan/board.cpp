@@ -5,74 +5,142 @@
 //MoveGenerator Board::mgen;
 
 Board::Board() {
-	current = new BoardComposite();
-	history_begin = current;
+	GetPlyBlock(0);
+	SetPlyBlock(0);
+	current = block_begin;
 	depth = 0;
+	ply_keys.resize(PLY_BLOCK_SIZE);
+	ply_keys[0] = current->hash;
 }
 
 Board::~Board() {
-	// Go to beginning of history linked-list
-	current = history_begin;
+	// Delete each block of the ply stack
+	for (BoardComposite * block : ply_blocks) {
+		delete[] block;
+	}
+}
+
+bool Board::SetCurrent(BoardState state) {
+	// Current is guaranteed to exist because it is allocated in constructor
+	ClearPlyKey(depth);
+	bool status = current->Init(state);
+	SetPlyKey(depth, current->hash);
+	return status;
+}
+
+void Board::SetRepetitionFilter(bool enable) {
+	repetition_filter.clear();
+	if (!enable) return;
 	
-	// Delete each Board Composite
-	BoardComposite * next = current->next;
-	while (current) {
-		next = current->next;
-		delete current;
-		current = next;
+	// Count the keys already on the move sequence
+	repetition_filter.resize(REPETITION_FILTER_SIZE, 0);
+	for (uint32_t ply = 0; ply <= (uint32_t)depth + in_place_depth; ply++) {
+		repetition_filter[ply_keys[ply] & (REPETITION_FILTER_SIZE - 1)]++;
+	}
+}
+
+const BoardComposite * Board::GetPly(uint16_t ply) const {
+	// Block i starts at ply PLY_BLOCK_SIZE * (2^i - 1)
+	uint32_t index = 0;
+	uint32_t start = 0;
+	while (ply >= start + ((uint32_t)PLY_BLOCK_SIZE << index)) {
+		start += (uint32_t)PLY_BLOCK_SIZE << index;
+		index++;
+	}
+	return ply_blocks[index] + (ply - start);
+}
+
+BoardComposite * Board::GetPlyBlock(uint16_t index) {
+	if (index >= ply_blocks.size()) {
+		// Blocks are only ever requested one past the end of the stack
+		ply_blocks.push_back(new BoardComposite[(uint32_t)PLY_BLOCK_SIZE << index]);
 	}
+	return ply_blocks[index];
 }
 
 std::vector<Move> Board::GetMadeMoves() {
 	std::vector<Move> output = std::vector<Move>(GetDepth());
 	std::vector<Move>::iterator output_i = output.begin();
-	BoardComposite * pos = history_begin;
-	while (pos != current) {
-		*(output_i++) = pos->move_to_next;
-		pos = pos->next;
+	for (uint16_t ply = 0; ply < depth; ply++) {
+		*(output_i++) = GetPly(ply)->move_to_next;
 	}
 	return output;
 }
 
 const MoveList * Board::GetMoves() {
-	if (!current->move_cache.IsValid()) {
+	// A cached list of legal moves is not a complete list of pseudo-legal moves
+	if (!current->move_cache.IsValid() || current->move_cache.IsLegal()) {
 		mgen.GetMoves(current, &(current->move_cache));
 	}
 	return &current->move_cache;
 }
 
-const MoveList * Board::GetUnmoves() {
-	if (!current->unmove_cache.IsValid()) {
-		mgen.GetUnmoves(current, &(current->unmove_cache));
+const MoveList * Board::GetLegalMoves() {
+	if (!current->move_cache.IsValid() || !current->move_cache.IsLegal()) {
+		mgen.GetLegalMoves(current, &(current->move_cache));
 	}
-	return &current->unmove_cache;
+	return &current->move_cache;
+}
+
+StagedMoveGenerator Board::GetStagedMoves(Move hash_move, Move killer_1, Move killer_2) {
+	return StagedMoveGenerator(&mgen, current, hash_move, killer_1, killer_2);
+}
+
+const MoveList * Board::GetUnmoves() {
+	mgen.GetUnmoves(current, &unmoves);
+	return &unmoves;
 }
 
 bool Board::HasLegalMoves() {
-	GetMoves();
-	bool color = current->state.white_to_move;
-	const Move * move = current->move_cache.Begin(); 
-	const Move * end_move = current->move_cache.End();
-	for (; move < end_move; move++) {
-		if (Make(*move)) {
-			bool in_check = InCheck(color);
-			Unmake(1);
-			if (!in_check) return true;
-		}
-	}
-	return false;
+	return HasAnyLegalMove();
+}
+
+int Board::CountLegalMoves() {
+	// Use the cached list if the legal moves have already been generated
+	if (current->move_cache.IsValid() && current->move_cache.IsLegal()) return current->move_cache.Length();
+	return mgen.CountLegalMoves(current);
+}
+
+bool Board::HasAnyLegalMove() {
+	if (current->move_cache.IsValid() && current->move_cache.IsLegal()) return current->move_cache.Length() > 0;
+	return mgen.HasAnyLegalMove(current);
+}
+
+bool Board::IsPseudoLegal(Move move) {
+	return mgen.IsPseudoLegal(current, move);
+}
+
+bool Board::IsLegal(Move move) {
+	return mgen.IsLegal(current, move);
+}
+
+bool Board::GivesCheck(Move move) {
+	return mgen.GivesCheck(current, move);
 }
 
 bool Board::InCheck(bool is_white) {
 	return mgen.InCheck(current, is_white);
 }
 
+GameStatus Board::GetStatus() {
+	GameStatus & status = current->status;
+	if (!status.IsValid()) {
+		status.in_check = InCheck(current->state.white_to_move);
+		status.has_legal_moves = HasAnyLegalMove();
+		status.repetition = IsDrawByRepetition();
+		status.no_progress = IsDrawByNoProgress();
+		status.insufficient_material = IsDrawByInsufficientMaterial();
+		status.Validate();
+	}
+	return status;
+}
+
 bool Board::IsCheckmate() {
-	return InCheck(current->state.white_to_move) && !HasLegalMoves();
+	return GetStatus().IsCheckmate();
 }
 
 bool Board::IsStalemate() {
-	return !InCheck(current->state.white_to_move) && !HasLegalMoves();
+	return GetStatus().IsStalemate();
 }
 
 bool Board::IsDrawByNoProgress() {
@@ -81,48 +149,50 @@ bool Board::IsDrawByNoProgress() {
 }
 
 bool Board::IsDrawByRepetition() {
-	const BoardComposite * board = current;
-	
-	// Repetition is impossible with progress in the last four moves
-	if (current->state.n_ply_without_progress < 4) return false;
+	// Only positions since the last progress can be repeated, and the nearest
+	// one with the same color to move that could be is four ply back
+	int top = depth + in_place_depth;
+	int window = current->state.n_ply_without_progress < top ? current->state.n_ply_without_progress : top;
+	if (window < 4) return false;
 	
-	// Go back four ply: is minimum distance at which a repetition could occur
-	for (int i = 0; i < 4; i++) {
-		if (board->last) board = board->last;
-		else return false;
-	}
+	Hash_t key = ply_keys[top];
+	if (!repetition_filter.empty() && repetition_filter[key & (REPETITION_FILTER_SIZE - 1)] < 2) return false;
 	
-	// Go back two until the linked list is exhausted or the last progress
-	const BoardComposite * recent;
-	for (int i = 4; i < current->state.n_ply_without_progress;) {
-		recent = board;
-		if (board->last) board = board->last;
-		else return false;
-		
-		if (board->last) board = board->last;
-		else return false;
-		
-		if (*recent == *board) return true;
-		else i += 2;
+	// Compare keys two ply at a time, confirming any match with the state
+	// unless the earlier position was made in place and no longer exists
+	const Hash_t * keys = ply_keys.data() + top;
+	for (int i = 4; i <= window; i += 2) {
+		if (keys[-i] == key && (top - i > depth || GetPly(top - i)->state == current->state)) return true;
 	}
 	
 	return false;
 }
 
-bool Board::IsDraw() {
-	return IsDrawByNoProgress() || IsDrawByRepetition() || IsStalemate();
-}
-
-/*
 bool Board::IsDrawByInsufficientMaterial() {
-	uint64_t roster[16];
-	memcpy(roster, current->roster, 16);
-	// General conditions
+	const uint8_t * roster = current->roster;
+	
+	// Pawns, rooks and queens can always force or help mate
 	if (roster[WHITE_PAWN] || roster[BLACK_PAWN]) return false;
-	else if (roster[WHITE_QUEEN] || roster[BLACK_QUEEN]) return false;
-	else if (roster[WHITE_ROOK] || roster[BLACK_ROOK]) return false;
+	if (roster[WHITE_ROOK] || roster[BLACK_ROOK]) return false;
+	if (roster[WHITE_QUEEN] || roster[BLACK_QUEEN]) return false;
+	
+	// Bare kings, or a single minor piece
+	int n_knights = roster[WHITE_KNIGHT] + roster[BLACK_KNIGHT];
+	int n_bishops = roster[WHITE_BISHOP] + roster[BLACK_BISHOP];
+	if (n_knights + n_bishops <= 1) return true;
+	
+	// Bishops that all stand on squares of one color can never attack the other
+	if (n_knights == 0) {
+		const Bitboard_t LIGHT_SQUARES = 0x55aa55aa55aa55aa;
+		Bitboard_t bishops = current->pieces[WHITE_BISHOP] | current->pieces[BLACK_BISHOP];
+		return !(bishops & LIGHT_SQUARES) || !(bishops & ~LIGHT_SQUARES);
+	}
+	return false;
+}
+
+bool Board::IsDraw() {
+	return GetStatus().IsDraw();
 }
-*/
 
 std::ostream & operator << (std::ostream & os, const Board & board) {
 	os << "+=========================================================================+" << std::endl;
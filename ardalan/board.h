@@ -3,7 +3,10 @@
 
 #include "datatypes.h"
 #include "movegen.h"
+#include "perft.h"
+#include "stagedgen.h"
 
+#include <utility>
 #include <vector>
 
 /**
@@ -15,12 +18,40 @@
  */
 class Board {
 protected:
+	// Positions along the move sequence are kept in a stack of preallocated
+	// blocks, each twice the size of the one before; blocks are never moved,
+	// so pointers into the current position stay valid as the stack grows
+	static const uint16_t PLY_BLOCK_SIZE = 32;
+	std::vector<BoardComposite *> ply_blocks;
 	BoardComposite * current = NULL;
-	BoardComposite * history_begin = NULL;
+	BoardComposite * block_begin = NULL;
+	BoardComposite * block_end = NULL;
+	uint16_t block_index = 0;
 	uint16_t depth = 0;
 	
+	// Number of moves currently made in place on top of the current position
+	uint16_t in_place_depth = 0;
+	
+	// Zobrist keys of the positions along the move sequence, indexed by ply, so
+	// that repetitions are found without visiting the positions themselves;
+	// positions reached by moves made in place follow those of the depth
+	std::vector<Hash_t> ply_keys;
+	
+	// Optional counts of the keys along the move sequence by their lowest bits;
+	// a position can only be a repetition if its count is more than one
+	static const int REPETITION_FILTER_SIZE = 1024;
+	std::vector<uint16_t> repetition_filter;
+	
 	MoveGenerator mgen;
 	
+	// Scratch positions for moves that are made in several steps (castling and
+	// en passant); kept per board so that boards can be used in parallel
+	BoardComposite intermediate[2];
+	
+	// Unmoves of the current position; only retrograde analysis needs them, so
+	// they are kept once per board rather than cached in every position
+	MoveList unmoves;
+	
 public:
 	Board();
 	Board(const Board & other) = delete;
@@ -32,10 +63,7 @@ public:
 	 * @param state State to apply.
 	 * @return Returns whether Board Composite initialization succeeded.
 	 */
-	inline bool SetCurrent(BoardState state) {
-		// Current is guaranteed to exist because it is allocated in constructor
-		return current->Init(state);
-	}
+	bool SetCurrent(BoardState state);
 	
 	/**
 	 * @brief Get the current board state.
@@ -46,13 +74,23 @@ public:
 		return current->state;
 	}
 	
+	/**
+	 * @brief Get the current board state in packed form.
+	 * @return A fresh packed copy of the state.
+	 */
+	inline PackedState GetCurrentPacked() const {
+		PackedState packed;
+		packed.Init(*current);
+		return packed;
+	}
+	
 	/**
 	 * @brief Get the initial board state.
 	 * @return A fresh copy of the state.
 	 */
 	inline BoardState GetInitial() const {
 		// History is guaranteed to exist because it is allocated in constructor
-		return history_begin->state;
+		return ply_blocks[0]->state;
 	}
 	
 	/**
@@ -97,23 +135,124 @@ public:
 	 */
 	bool Unmake(uint16_t n_moves);
 	
+	/**
+	 * @brief Make a move by changing the current position in place.
+	 * @param move Move to make.
+	 * @param undo Filled with what is needed to take the move back.
+	 * @return Returns whether the move was legal and if the state was changed.
+	 * 
+	 * The same conditions of move legality are checked as by Make. The depth and
+	 * made moves are not changed, and the cached move lists and status of the
+	 * current position are cleared. Repetitions are still found, although
+	 * positions reached in place are matched by their keys alone. Moves made in
+	 * place must be taken back with UnmakeInPlace, in reverse order, before
+	 * Make, Unmake or SetCurrent are used again.
+	 */
+	bool MakeInPlace(Move move, Undo * undo);
+	
+	/**
+	 * @brief Take back the last move made in place.
+	 * @param undo Record filled when the move was made.
+	 */
+	void UnmakeInPlace(const Undo & undo);
+	
 	bool MakePGNMoves(const char * pgn);
 	
+	/**
+	 * @brief Count the leaf nodes of the legal move tree from the current position.
+	 * @param depth Number of ply to search.
+	 * @return Number of positions reachable in exactly depth ply.
+	 * 
+	 * The last ply is counted in bulk from the length of the legal move list
+	 * rather than by making each move.
+	 */
+	uint64_t Perft(uint8_t depth);
+	
+	/**
+	 * @brief Count the leaf nodes under each legal move from the current position.
+	 * @param depth Number of ply to search, including the root move.
+	 * @return One entry per root move, in generation order.
+	 */
+	std::vector<std::pair<Move, uint64_t>> Divide(uint8_t depth);
+	
+	/**
+	 * @brief Count the leaf nodes of the legal move tree using several threads.
+	 * @param depth Number of ply to search.
+	 * @param n_threads Number of worker threads; 0 to use one per core.
+	 * @return Number of positions reachable in exactly depth ply.
+	 * 
+	 * The subtrees two ply below the current position are shared out between
+	 * the threads, each of which searches with its own Board.
+	 */
+	uint64_t ParallelPerft(uint8_t depth, unsigned n_threads = 0);
+	
+	/**
+	 * @brief Count the leaf nodes of the legal move tree, caching subtree counts.
+	 * @param depth Number of ply to search.
+	 * @param table Table of subtree counts, which can be reused between calls.
+	 * @return Number of positions reachable in exactly depth ply.
+	 * 
+	 * Subtrees are identified by the Zobrist hash of their root position and
+	 * their depth, so positions reached by transposition are only counted once.
+	 */
+	uint64_t HashPerft(uint8_t depth, PerftTable * table);
+	
+	/**
+	 * @brief Count the leaf nodes of the legal move tree, making moves in place.
+	 * @param depth Number of ply to search.
+	 * @return Number of positions reachable in exactly depth ply.
+	 * 
+	 * Gives the same counts as Perft, but with a single Board Composite that is
+	 * updated and restored from undo records instead of one copy per ply.
+	 */
+	uint64_t PerftInPlace(uint8_t depth);
+	
+protected:
+	// Perft with moves made in place keeps the move list of each ply in lists[depth - 1]
+	uint64_t PerftInPlace(uint8_t depth, MoveList * lists);
+	
+public:
 	/**
 	 * @brief Generate the available pseudo-legal moves for whichever color to move.
 	 * @return Returns an unalterable pointer to the cached moves associated with the current Board Composite.
 	 * 
 	 * Be careful to not refer to the returned pointer to a list unless the
 	 * board is currently in a state such that the generated moves are valid.
+	 * The pseudo-legal and legal moves share one cache, so the list is also
+	 * replaced by a call to GetLegalMoves.
 	 */
 	const MoveList * GetMoves();
 	
 	/**
-	 * @brief Generate the available pseudo-legal moves that could have been just made by the other color.
+	 * @brief Generate the available legal moves for whichever color to move.
 	 * @return Returns an unalterable pointer to the cached moves associated with the current Board Composite.
 	 * 
 	 * Be careful to not refer to the returned pointer to a list unless the
 	 * board is currently in a state such that the generated moves are valid.
+	 * The pseudo-legal and legal moves share one cache, so the list is also
+	 * replaced by a call to GetMoves.
+	 */
+	const MoveList * GetLegalMoves();
+	
+	/**
+	 * @brief Generate the legal moves for whichever color to move in stages.
+	 * @param hash_move Move to try first, if it is legal.
+	 * @param killer_1 Quiet move to try before other quiet moves, if it is legal.
+	 * @param killer_2 Quiet move to try before other quiet moves, if it is legal.
+	 * @return Returns a generator that yields moves from the current Board Composite.
+	 * 
+	 * The generator remains valid while moves are made and unmade from the
+	 * current position, but not once the current position is replaced.
+	 */
+	StagedMoveGenerator GetStagedMoves(Move hash_move = Move(), Move killer_1 = Move(), Move killer_2 = Move());
+	
+	/**
+	 * @brief Generate the available pseudo-legal moves that could have been just made by the other color.
+	 * @return Returns an unalterable pointer to a list held by the board.
+	 * 
+	 * The unmoves are not cached; the list is regenerated on every call, so
+	 * do not refer to the returned pointer after the next call or after the
+	 * board has changed.
 	 */
 	const MoveList * GetUnmoves();
 	
@@ -123,6 +262,41 @@ public:
 	 */
 	bool HasLegalMoves();
 	
+	/**
+	 * @brief Count the legal moves of the color to move without generating a list.
+	 * @return Returns the number of legal moves, limited like GetLegalMoves to
+	 * the capacity of a move list.
+	 */
+	int CountLegalMoves();
+	
+	/**
+	 * @brief Determine whether the color to move has a legal move, stopping at
+	 * the first one found instead of generating them all.
+	 * @return
+	 */
+	bool HasAnyLegalMove();
+	
+	/**
+	 * @brief Determine whether a move is pseudo-legal for the color to move.
+	 * @param move Move to check.
+	 * @return True if GetMoves would include the move; no moves are generated.
+	 */
+	bool IsPseudoLegal(Move move);
+	
+	/**
+	 * @brief Determine whether a move is legal for the color to move.
+	 * @param move Move to check.
+	 * @return True if GetLegalMoves would include the move; no moves are generated.
+	 */
+	bool IsLegal(Move move);
+	
+	/**
+	 * @brief Determine whether a legal move of the color to move gives check.
+	 * @param move Move to check; it is not made.
+	 * @return
+	 */
+	bool GivesCheck(Move move);
+	
 	/**
 	 * @brief Determine whether the specified color is in check.
 	 * @param is_white True to check for white being in check, false for black.
@@ -130,6 +304,14 @@ public:
 	 */
 	bool InCheck(bool is_white);
 	
+	/**
+	 * @brief Find whether the color to move is in check, checkmate, or stalemate,
+	 * and whether the position is drawn, all at once.
+	 * @return The status, which is cached with the current position until the
+	 * next move is made.
+	 */
+	GameStatus GetStatus();
+	
 	/**
 	 * @brief Determine whether the color to move is in checkmate.
 	 * @return 
@@ -144,7 +326,8 @@ public:
 	
 	/**
 	 * @brief Determine whether a draw can be claimed from insufficient material.
-	 * @return 
+	 * @return True if neither side can mate: bare kings, a single minor piece,
+	 * or only bishops that all stand on squares of the same color.
 	 */
 	bool IsDrawByInsufficientMaterial();
 	
@@ -160,6 +343,16 @@ public:
 	 */
 	bool IsDrawByRepetition();
 	
+	/**
+	 * @brief Keep a small hash set of the positions along the move sequence.
+	 * @param enable Whether to keep the set.
+	 * 
+	 * With the set, repetition checks of positions that have not occurred
+	 * before return without scanning the earlier keys, which helps in long
+	 * games; keeping it up to date costs a little in Make and Unmake.
+	 */
+	void SetRepetitionFilter(bool enable);
+	
 	/**
 	 * @brief Check if any draw conditions are met.
 	 * @return 
@@ -170,12 +363,59 @@ public:
 	bool IsDraw();
 	
 protected:
-	bool MakeComplete(const BoardComposite * orig, BoardComposite * target,
+	/**
+	 * @brief Get the position at a given ply of the move sequence.
+	 * @param ply Ply from the initial position; must not exceed the depth.
+	 * @return
+	 */
+	const BoardComposite * GetPly(uint16_t ply) const;
+	
+	/**
+	 * @brief Get the first position of a block of the ply stack, allocating it if needed.
+	 * @param index Index of the block.
+	 * @return
+	 */
+	BoardComposite * GetPlyBlock(uint16_t index);
+	
+	/**
+	 * @brief Record the key of the position at a ply, counting it in the repetition filter.
+	 * @param ply Ply from the initial position, at most one past the last recorded.
+	 * @param key Zobrist key of the position.
+	 */
+	inline void SetPlyKey(uint32_t ply, Hash_t key) {
+		if (ply == ply_keys.size()) ply_keys.resize(2 * ply_keys.size());
+		ply_keys[ply] = key;
+		if (!repetition_filter.empty()) repetition_filter[key & (REPETITION_FILTER_SIZE - 1)]++;
+	}
+	
+	/**
+	 * @brief Remove the key of the position at a ply from the repetition filter.
+	 * @param ply Ply from the initial position.
+	 */
+	inline void ClearPlyKey(uint32_t ply) {
+		if (!repetition_filter.empty()) repetition_filter[ply_keys[ply] & (REPETITION_FILTER_SIZE - 1)]--;
+	}
+	
+	/**
+	 * @brief Move the bounds of the current block of the ply stack.
+	 * @param index Index of the block, which must already be allocated.
+	 */
+	inline void SetPlyBlock(uint16_t index) {
+		block_index = index;
+		block_begin = ply_blocks[index];
+		block_end = block_begin + ((uint32_t)PLY_BLOCK_SIZE << index);
+	}
+	
+	// Move making is specialized for the color to move (WHITE or BLACK)
+	template <bool IS_WHITE> bool MakeMove(const BoardComposite * orig, BoardComposite * target, Move move);
+	template <bool IS_WHITE> bool MakeComplete(const BoardComposite * orig, BoardComposite * target,
 		uint8_t start, uint8_t end, uint8_t start_piece, uint8_t end_piece, uint8_t promotion_piece);
-	bool MakeNormal(const BoardComposite * orig, BoardComposite * target, Move move);
-	bool MakeCastling(const BoardComposite * orig, BoardComposite * target, Move move);
-	bool MakeEnPassant(const BoardComposite * orig, BoardComposite * target, Move move);
-	bool MakePromotion(const BoardComposite * orig, BoardComposite * target, Move move);
+	template <bool IS_WHITE> bool MakeInPlace(BoardComposite * board, Move move, Undo * undo);
+	template <bool IS_WHITE> void UnmakeInPlace(BoardComposite * board, const Undo & undo);
+	template <bool IS_WHITE> bool MakeNormal(const BoardComposite * orig, BoardComposite * target, Move move);
+	template <bool IS_WHITE> bool MakeCastling(const BoardComposite * orig, BoardComposite * target, Move move);
+	template <bool IS_WHITE> bool MakeEnPassant(const BoardComposite * orig, BoardComposite * target, Move move);
+	template <bool IS_WHITE> bool MakePromotion(const BoardComposite * orig, BoardComposite * target, Move move);
 	
 public:
 	friend std::ostream & operator << (std::ostream & os, const Board & board);
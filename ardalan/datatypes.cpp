@@ -5,6 +5,10 @@
 #include <sstream>
 #include <string.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 uint8_t Text2Coord(const char * text) {
 	return (text[0] - 'a') + 8 * (text[1] - '1');
 }
@@ -135,45 +139,49 @@ std::ostream & operator << (std::ostream & os, Move m) {
 	return os;
 }
 
+std::ostream & operator << (std::ostream & os, Unmove unmove) {
+	os << unmove.move;
+	if (unmove.uncapture) {
+		os << "x" << "-PNBRQK--pnbrqk-"[unmove.uncapture];
+	}
+	if (unmove.castling) {
+		os << "[";
+		for (int i = 0; i < 4; i++) {
+			if (unmove.castling & (1 << i)) os << "KQkq"[i];
+		}
+		os << "]";
+	}
+	if (unmove.ep_target) {
+		os << "[e.p. " << Coord2Text(unmove.ep_target) << "]";
+	}
+	return os;
+}
+
 MoveList::MoveList() {
-	this->moves = NULL;
-	this->n_alloc = 0;
 	this->n_moves = 0;
 	this->valid = false;
+	this->truncated = false;
+	this->legal = false;
 }
 
 MoveList::MoveList(const MoveList & other) {
-	this->n_alloc = other.n_alloc;
+	// Only the moves in use need to be copied
 	this->n_moves = other.n_moves;
 	this->valid = other.valid;
-	
-	this->moves = new Move[other.n_alloc];
-	memcpy(this->moves, other.moves, other.n_alloc * sizeof(Move));
+	this->truncated = other.truncated;
+	this->legal = other.legal;
+	memcpy(this->moves, other.moves, other.n_moves * sizeof(Move));
 }
 
 MoveList & MoveList::operator =(const MoveList & other) {
-	Move * temp_moves = new Move[other.n_alloc];
-	delete[] this->moves;
-	
-	this->n_alloc = other.n_alloc;
 	this->n_moves = other.n_moves;
 	this->valid = other.valid;
-	
-	this->moves = temp_moves;
-	memcpy(this->moves, other.moves, other.n_alloc * sizeof(Move));
-	
+	this->truncated = other.truncated;
+	this->legal = other.legal;
+	memcpy(this->moves, other.moves, other.n_moves * sizeof(Move));
 	return *this;
 }
 
-MoveList::~MoveList() {
-	if (this->moves) {
-		delete[] this->moves;
-		this->moves = NULL;
-	}
-	this->n_alloc = 0;
-	this->n_moves = 0;
-}
-
 std::ostream & operator << (std::ostream & os, const MoveList & ml) {
 	if (!ml.valid) {
 		os << "{Uninitialized Move List}";
@@ -407,7 +415,8 @@ bool BoardComposite::Init(const BoardState state) {
 	this->state = state;
 	
 	// Reset the state
-	white = black = wpawns = bpawns = 0;
+	white = black = 0;
+	memset(pieces, 0, sizeof(pieces));
 	wking_pos = bking_pos = 255;
 	hash = state.GetHash();
 	#ifdef ARDALAN_DISCRETE_SCORING
@@ -415,7 +424,7 @@ bool BoardComposite::Init(const BoardState state) {
 	#endif
 	memset(roster, 0, 16);
 	move_cache.Clear();
-	unmove_cache.Clear();
+	status.Clear();
 	move_to_next = Move(0, 0, Move::NULL_MOVE);
 	move_from_last = Move(0, 0, Move::NULL_MOVE);
 	
@@ -424,32 +433,39 @@ bool BoardComposite::Init(const BoardState state) {
 		uint8_t piece = state.squares[i];
 		if (piece >= WHITE_PAWN && piece <= WHITE_KING) {
 			white |= ONE << i;
-			if (piece == WHITE_PAWN) wpawns |= ONE << i;
-			else if (piece == WHITE_KING) wking_pos = i;
+			if (piece == WHITE_KING) wking_pos = i;
 			roster[piece]++;
 		}
 		else if (piece >= BLACK_PAWN && piece <= BLACK_KING) {
 			black |= ONE << i;
-			if (piece == BLACK_PAWN) bpawns |= ONE << i;
-			else if (piece == BLACK_KING) bking_pos = i;
+			if (piece == BLACK_KING) bking_pos = i;
 			roster[piece]++;
 		}
+		pieces[piece & 15] |= ONE << i;
 	}
 	
 	return true;
 }
 
+Material_t BoardComposite::GetMaterial() const {
+	Material_t material = 0;
+	for (int piece = WHITE_PAWN; piece <= BLACK_KING; piece++) {
+		material += roster[piece] * MaterialOf(piece);
+	}
+	return material;
+}
+
 std::ostream & operator << (std::ostream & os, const BoardComposite & bc) {
 	os << "+=========================================================================+" << std::endl;
 	os << bc.state;
 	os << "| THIS: " << &bc << std::endl;
-	os << "| Move From Last: " << bc.move_from_last << " (" << bc.last << ")" << std::endl;
-	os << "| Move To Next:   " << bc.move_to_next << " (" << bc.next << ")" << std::endl;
+	os << "| Move From Last: " << bc.move_from_last << std::endl;
+	os << "| Move To Next:   " << bc.move_to_next << std::endl;
 	os << std::hex;
 	os << "| White:       " << std::setfill('0') << std::setw(16) << bc.white << std::endl;
-	os << "| White Pawns: " << std::setfill('0') << std::setw(16) << bc.wpawns << std::endl;
+	os << "| White Pawns: " << std::setfill('0') << std::setw(16) << bc.pieces[WHITE_PAWN] << std::endl;
 	os << "| Black:       " << std::setfill('0') << std::setw(16) << bc.black << std::endl;
-	os << "| Black Pawns: " << std::setfill('0') << std::setw(16) << bc.bpawns << std::endl;
+	os << "| Black Pawns: " << std::setfill('0') << std::setw(16) << bc.pieces[BLACK_PAWN] << std::endl;
 	os << "| Hash:        " << std::setfill('0') << std::setw(16) << bc.hash << std::endl;
 	os << std::dec;
 	os << "| Roster: " << std::endl;
@@ -458,7 +474,101 @@ std::ostream & operator << (std::ostream & os, const BoardComposite & bc) {
 	os << "| White King: " << Coord2Text(bc.wking_pos) << std::endl;
 	os << "| Black King: " << Coord2Text(bc.bking_pos) << std::endl;
 	os << "| Move cache:  " << bc.move_cache << std::endl;
-	os << "| Unmove cache: " << bc.unmove_cache << std::endl;
 	os << "+=========================================================================+" << std::endl;
 	return os;
-}
\ No newline at end of file
+}
+
+// Shared by both ways of packing once the pieces have been listed
+static inline void PackFlags(PackedState * packed, const BoardState & state) {
+	packed->flags =
+		(state.white_to_move ? PackedState::FLAG_WHITE_TO_MOVE : 0) |
+		(state.white_OO ? PackedState::FLAG_WHITE_OO : 0) |
+		(state.white_OOO ? PackedState::FLAG_WHITE_OOO : 0) |
+		(state.black_OO ? PackedState::FLAG_BLACK_OO : 0) |
+		(state.black_OOO ? PackedState::FLAG_BLACK_OOO : 0);
+	packed->ep_target = state.ep_target;
+	packed->n_ply_without_progress = state.n_ply_without_progress;
+}
+
+bool PackedState::Init(const BoardState & state) {
+	// Find the occupied squares without branching on each square
+	#ifdef __SSE2__
+	const __m128i empty = _mm_setzero_si128();
+	occupancy = 0;
+	for (int i = 0; i < 4; i++) {
+		__m128i squares = _mm_loadu_si128((const __m128i *)(state.squares + 16 * i));
+		occupancy |= (Bitboard_t)(uint16_t)~_mm_movemask_epi8(_mm_cmpeq_epi8(squares, empty)) << (16 * i);
+	}
+	#else
+	occupancy = 0;
+	for (int i = 0; i < 64; i++) {
+		occupancy |= (Bitboard_t)(state.squares[i] != EMPTY) << i;
+	}
+	#endif
+	if (CountBits(occupancy) > MAX_PIECES) return false;
+	
+	pieces[0] = pieces[1] = 0;
+	Bitboard_t remaining = occupancy;
+	for (int n_pieces = 0; remaining; n_pieces++) {
+		pieces[n_pieces >> 4] |= (uint64_t)state.squares[PopLSB(remaining)] << (4 * (n_pieces & 15));
+	}
+	PackFlags(this, state);
+	return true;
+}
+
+bool PackedState::Init(const BoardComposite & board) {
+	occupancy = board.white | board.black;
+	if (CountBits(occupancy) > MAX_PIECES) return false;
+	
+	pieces[0] = pieces[1] = 0;
+	Bitboard_t remaining = occupancy;
+	for (int n_pieces = 0; remaining; n_pieces++) {
+		pieces[n_pieces >> 4] |= (uint64_t)board.state.squares[PopLSB(remaining)] << (4 * (n_pieces & 15));
+	}
+	PackFlags(this, board.state);
+	return true;
+}
+
+BoardState PackedState::GetState() const {
+	BoardState state;
+	memset(state.squares, EMPTY, 64);
+	Bitboard_t remaining = occupancy;
+	for (int n_pieces = 0; remaining; n_pieces++) {
+		state.squares[PopLSB(remaining)] = (pieces[n_pieces >> 4] >> (4 * (n_pieces & 15))) & 15;
+	}
+	state.white_to_move = flags & FLAG_WHITE_TO_MOVE;
+	state.white_OO = flags & FLAG_WHITE_OO;
+	state.white_OOO = flags & FLAG_WHITE_OOO;
+	state.black_OO = flags & FLAG_BLACK_OO;
+	state.black_OOO = flags & FLAG_BLACK_OOO;
+	state.ep_target = ep_target;
+	state.n_ply_without_progress = n_ply_without_progress;
+	return state;
+}
+
+static Hash_t GetEmptyBoardHash() {
+	Hash_t output = 0;
+	for (int i = 0; i < 64; i++) {
+		output ^= ZOBRIST_SQUARES[EMPTY][i];
+	}
+	return output;
+}
+
+Hash_t PackedState::GetHash() const {
+	// Start from the hash of an empty board and change only the occupied squares
+	static const Hash_t empty_board = GetEmptyBoardHash();
+	Hash_t output = empty_board;
+	output ^= (flags & FLAG_WHITE_TO_MOVE) ? ZOBRIST_WHITE_TO_MOVE : 0;
+	output ^= ZOBRIST_EN_PASSANT[ep_target];
+	output ^= ZOBRIST_WHITE_OO[(flags & FLAG_WHITE_OO) != 0];
+	output ^= ZOBRIST_WHITE_OOO[(flags & FLAG_WHITE_OOO) != 0];
+	output ^= ZOBRIST_BLACK_OO[(flags & FLAG_BLACK_OO) != 0];
+	output ^= ZOBRIST_BLACK_OOO[(flags & FLAG_BLACK_OOO) != 0];
+	Bitboard_t remaining = occupancy;
+	for (int n_pieces = 0; remaining; n_pieces++) {
+		uint8_t square = PopLSB(remaining);
+		uint8_t piece = (pieces[n_pieces >> 4] >> (4 * (n_pieces & 15))) & 15;
+		output ^= ZOBRIST_SQUARES[EMPTY][square] ^ ZOBRIST_SQUARES[piece][square];
+	}
+	return output;
+}
@@ -3,8 +3,12 @@
 
 #include "hash.h"
 
+#include <functional>
+#include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 #include <string>
+#include <vector>
 
 #define EMPTY			0
 #define WHITE_PAWN		1
@@ -20,10 +24,41 @@
 #define BLACK_QUEEN		13
 #define BLACK_KING		14
 
+// Colors, for template arguments that select the color to move
+#define WHITE			true
+#define BLACK			false
+
 typedef uint64_t Bitboard_t;
 typedef int16_t Score_t;
 typedef uint64_t Hash_t;
 
+// Material signature: the number of pieces of each piece code, in four bits
+// at four times the code, so that signatures can be added piece by piece
+typedef uint64_t Material_t;
+
+inline Material_t MaterialOf(uint8_t piece) {
+	return (Material_t)1 << (4 * piece);
+}
+
+inline int CountMaterial(Material_t material, uint8_t piece) {
+	return (material >> (4 * piece)) & 15;
+}
+
+/**
+ * @brief Remove the lowest set bit from a bitboard.
+ * @param x Bitboard to modify; must not be empty.
+ * @return The square of the removed bit.
+ */
+inline uint8_t PopLSB(Bitboard_t & x) {
+	uint8_t square = __builtin_ctzll(x);
+	x &= x - 1;
+	return square;
+}
+
+inline int CountBits(Bitboard_t x) {
+	return __builtin_popcountll(x);
+}
+
 uint8_t Text2Coord(const char * text);
 std::string Coord2Text(uint8_t coord);
 
@@ -86,6 +121,58 @@ public:
 	static const uint8_t NULL_MOVE = 15;
 } __attribute__((__packed__));
 
+/**
+ * @class Unmove
+ * @file datatypes.h
+ * @brief A way back from a position to one that could have preceded it.
+ * 
+ * The move is the one made in the earlier position: its end square is where
+ * the piece stands now, and its code marks en passant captures and promotions
+ * as usual; castling moves run from the home square of the king to where it
+ * stands now. Uncapture is the piece that the move captured, which reappears on
+ * the end square (or behind it for en passant), or EMPTY if it captured
+ * nothing. Material is the material signature of the earlier position.
+ * 
+ * Castling is the set of castling rights that the earlier position holds on
+ * top of those of this one, which the move lost, and ep_target is the pawn
+ * that had just made a double push in the earlier position (0 if none).
+ */
+struct Unmove {
+public:
+	Move move;
+	uint8_t uncapture;
+	Material_t material;
+	uint8_t castling;
+	uint8_t ep_target;
+	
+	// Castling rights, as bits of castling
+	static const uint8_t WHITE_OO = 1;
+	static const uint8_t WHITE_OOO = 2;
+	static const uint8_t BLACK_OO = 4;
+	static const uint8_t BLACK_OOO = 8;
+	
+	friend std::ostream & operator << (std::ostream & os, Unmove unmove);
+};
+
+/**
+ * @class Undo
+ * @file datatypes.h
+ * @brief What is needed to take back a move that was made in place.
+ * 
+ * The move and the captured piece (EMPTY if none) restore the squares; the
+ * rest are the parts of the earlier state that cannot be worked out from the
+ * later one.
+ */
+struct Undo {
+public:
+	Move move;
+	uint8_t captured;
+	bool white_OO, white_OOO, black_OO, black_OOO;
+	uint8_t ep_target;
+	uint8_t n_ply_without_progress;
+	Hash_t hash;
+};
+
 /**
  * @class MoveList
  * @author Daniel-Winkelman
@@ -93,22 +180,33 @@ public:
  * @file datatypes.h
  * @brief Stores all the pseudo-legal moves that can be made in a position.
  * 
- * Moves are listed serially. Memory is dynamically (but excessively) allocated
- * by the move generator, but can be freed whenever convenient. Moves in this
- * array are not guaranteed to be legal insofar as concerning check rules (like
- * moving into check, castling through check, undoing pins, etc.).
+ * Moves are listed serially in a fixed-capacity array held inside the list, so
+ * generating moves never allocates memory. Only positions that cannot arise in
+ * a game have more moves than fit; the list is then marked as truncated. Moves
+ * in this array are not guaranteed to be legal insofar as concerning check
+ * rules (like moving into check, castling through check, undoing pins, etc.)
+ * unless they were generated as legal moves, which the list records.
  * 
  * The list is accessed globally using STL-style begin/end functions, and direct
  * writing access is limited to the move generator.
  */
 struct MoveList {
+public:
+	// No legal chess position has more than 218 moves
+	static const int MAX_MOVES = 256;
+	
+	// Vectorized move emission stores up to this many moves at a time, which
+	// may reach past the last move
+	static const int EMIT_SLACK = 16;
+	
 protected:
 	friend class MoveGenerator;
 	
-	Move * moves = NULL;
-	uint16_t n_alloc = 0;
 	uint16_t n_moves = 0;
 	bool valid = false;
+	bool truncated = false;
+	bool legal = false;
+	Move moves[MAX_MOVES + EMIT_SLACK];
 	
 public:
 	inline const Move * Begin() const {
@@ -123,21 +221,105 @@ public:
 	inline void Clear() {
 		this->n_moves = 0;
 		this->valid = false;
+		this->truncated = false;
+		this->legal = false;
 	}
 	inline bool IsValid() const {
 		return this->valid;
 	}
+	inline bool IsTruncated() const {
+		return this->truncated;
+	}
+	inline bool IsLegal() const {
+		return this->legal;
+	}
 	
 public:
 	MoveList();
 	MoveList(const MoveList & other);
 	MoveList & operator =(const MoveList & other);
-	~MoveList();
 	
 public:
 	friend std::ostream & operator << (std::ostream & os, const MoveList & ml);
 } __attribute__((__packed__));
 
+/**
+ * @class MoveBatch
+ * @file datatypes.h
+ * @brief Stores the moves of many positions in one flat array.
+ * 
+ * The moves of position i are those from offsets[i] up to offsets[i + 1], so a
+ * batch of any number of positions lives in two arrays, which keep their
+ * memory when the batch is refilled. The batch is marked as truncated if the
+ * moves of any position did not fit in a move list.
+ */
+struct MoveBatch {
+public:
+	std::vector<Move> moves;
+	std::vector<uint32_t> offsets;
+	bool truncated = false;
+	
+public:
+	inline size_t Size() const {
+		return offsets.empty() ? 0 : offsets.size() - 1;
+	}
+	inline const Move * Begin(size_t position) const {
+		return moves.data() + offsets[position];
+	}
+	inline const Move * End(size_t position) const {
+		return moves.data() + offsets[position + 1];
+	}
+	inline int Length(size_t position) const {
+		return offsets[position + 1] - offsets[position];
+	}
+	inline void Clear() {
+		moves.clear();
+		offsets.clear();
+		truncated = false;
+	}
+};
+
+/**
+ * @class GameStatus
+ * @file datatypes.h
+ * @brief Whether a position is check, checkmate, stalemate, or drawn.
+ * 
+ * Everything is found at once and cached with the position, so that asking
+ * about checkmate, stalemate and draws in turn does not generate moves again.
+ */
+struct GameStatus {
+public:
+	bool in_check = false;
+	bool has_legal_moves = false;
+	bool repetition = false;
+	bool no_progress = false;
+	bool insufficient_material = false;
+	
+protected:
+	bool valid = false;
+	
+public:
+	inline bool IsCheckmate() const {
+		return in_check && !has_legal_moves;
+	}
+	inline bool IsStalemate() const {
+		return !in_check && !has_legal_moves;
+	}
+	inline bool IsDraw() const {
+		return IsStalemate() || repetition || no_progress || insufficient_material;
+	}
+	
+	inline void Clear() {
+		this->valid = false;
+	}
+	inline void Validate() {
+		this->valid = true;
+	}
+	inline bool IsValid() const {
+		return this->valid;
+	}
+};
+
 /**
  * @class BoardState
  * @author Daniel-Winkelman
@@ -202,11 +384,13 @@ public:
  * @file datatypes.h
  * @brief Stores essential data and associated data for other purposes.
  * 
- * This structure contains a board state, 64-bit bitboards for move generation,
- * the positions of both kings for check detection, a roster of the counts of
- * each type of piece on the board, a cache of moves generated from this
- * position, and optionally a Zobrist hashing system to accelerate comparison
- * and a field for storing incremental score data.
+ * This structure contains a board state, 64-bit bitboards for move generation
+ * (by color and by piece type), the positions of both kings for check
+ * detection, a Zobrist hash to accelerate comparison, a roster of the counts
+ * of each type of piece on the board, a cache of the moves (pseudo-legal or
+ * legal) generated from this position, a cache of the game status, the moves
+ * linking it to its neighbours in the move sequence, and optionally a field
+ * for storing incremental score data.
  */
 struct BoardComposite {
 	#ifdef ARDALAN_DISCRETE_SCORING
@@ -218,7 +402,10 @@ public:
 	
 	// Maintain bitboards representing white and black pieces
 	Bitboard_t white = 0, black = 0;
-	Bitboard_t wpawns = 0, bpawns = 0;
+	
+	// Maintain a bitboard for each type of piece (indexed like the roster);
+	// the EMPTY entry holds the empty squares
+	Bitboard_t pieces[16] = { 0 };
 	
 	// Maintain the positions of white and black kings to help check detection
 	uint8_t wking_pos = 255, bking_pos = 255;
@@ -234,13 +421,14 @@ public:
 	// Maintain a roster of the types of pieces on the board
 	uint8_t roster[16] = { 0 };
 	
-	// Cache moves that have been found in the position
+	// Cache moves that have been found in the position; the list records
+	// whether they were filtered to legal moves
 	MoveList move_cache;
-	MoveList unmove_cache;
 	
-	// Linked-list-style move stack
-	BoardComposite * next = NULL;
-	BoardComposite * last = NULL;
+	// Cache the status of the game in the position
+	GameStatus status;
+	
+	// Moves linking the position to its neighbours in the move sequence
 	Move move_from_last;
 	Move move_to_next;
 	
@@ -248,6 +436,8 @@ public:
 
 	bool Init(const BoardState state);
 	
+	Material_t GetMaterial() const;
+	
 	inline bool operator == (const BoardComposite & other) const {
 		// Short-circuit compare the hash
 		return this->hash == other.hash && this->state == other.state;
@@ -258,4 +448,87 @@ public:
 
 };
 
+/**
+ * @class PackedState
+ * @file datatypes.h
+ * @brief A Board State packed into 32 bytes for storing many positions.
+ * 
+ * The occupied squares are kept as a bitboard, and the pieces on them are
+ * listed in square order, four bits each, sixteen to a word from the lowest
+ * bits up. The color to move and castling rights
+ * share a byte of flags. As with Board States, the number of ply without
+ * progress is kept but neither compared nor hashed. No legal position has more
+ * than the 32 pieces that fit.
+ */
+struct PackedState {
+public:
+	static const int MAX_PIECES = 32;
+	
+	static const uint8_t FLAG_WHITE_TO_MOVE = 1;
+	static const uint8_t FLAG_WHITE_OO = 2;
+	static const uint8_t FLAG_WHITE_OOO = 4;
+	static const uint8_t FLAG_BLACK_OO = 8;
+	static const uint8_t FLAG_BLACK_OOO = 16;
+	
+	Bitboard_t occupancy = 0;
+	uint64_t pieces[MAX_PIECES / 16] = { 0 };
+	uint8_t flags = 0;
+	uint8_t ep_target = 0;
+	uint8_t reserved[5] = { 0 };
+	
+	// Must be last: comparison stops short of it
+	uint8_t n_ply_without_progress = 0;
+	
+public:
+	PackedState() {}
+	explicit PackedState(const BoardState & state) {
+		Init(state);
+	}
+	
+	/**
+	 * @brief Pack a Board State.
+	 * @param state State to pack.
+	 * @return Returns false if the state has more pieces than fit.
+	 */
+	bool Init(const BoardState & state);
+	
+	/**
+	 * @brief Pack the state of a Board Composite, using its bitboards to find the pieces.
+	 * @param board Board Composite to pack.
+	 * @return Returns false if the state has more pieces than fit.
+	 */
+	bool Init(const BoardComposite & board);
+	
+	/**
+	 * @brief Unpack into a Board State.
+	 * @return A fresh copy of the state.
+	 */
+	BoardState GetState() const;
+	
+	/**
+	 * @brief Get the Zobrist hash of the position.
+	 * @return The same hash as for the unpacked Board State.
+	 */
+	Hash_t GetHash() const;
+	
+	// Compare critical states
+	inline bool operator == (const PackedState & other) const {
+		return memcmp(this, &other, offsetof(PackedState, n_ply_without_progress)) == 0;
+	}
+	inline bool operator != (const PackedState & other) const {
+		return !(*this == other);
+	}
+	inline bool operator < (const PackedState & other) const {
+		return memcmp(this, &other, offsetof(PackedState, n_ply_without_progress)) < 0;
+	}
+};
+
+namespace std {
+	template <> struct hash<PackedState> {
+		inline size_t operator () (const PackedState & state) const {
+			return state.GetHash();
+		}
+	};
+}
+
 #endif
\ No newline at end of file
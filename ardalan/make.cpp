@@ -19,76 +19,85 @@
  * BOARD COMPOSITE
  *-----------------
  * Bitboards [complete]
+ * Piece Bitboards [complete]
  * King Positions [complete]
  * Piece Roster [complete]
  * Move Cache [main]
- * Next and Last Positions [main]
+ * Game Status Cache [main]
  * Move to Next and Last Positions [main]
  */
 
 bool Board::Make(Move move) {
 	bool status = true;
 	
-	// Get Board Composites for move making
-	if (!current->next) {
-		// Allocate a next link in the list if it does not exist
-		current->next = new BoardComposite();
-		current->next->last = current;
-	}
+	// Get Board Composites for move making; the next position is usually the
+	// adjacent slot of the ply stack, unless the current block is full
+	const BoardComposite * orig = current;
+	BoardComposite * target = current + 1;
+	bool next_block = target == block_end;
+	if (next_block) target = GetPlyBlock(block_index + 1);
 	
 	// Reset move to next/from last linkage
 	current->move_to_next = Move(0, 0, Move::NULL_MOVE);
-	current->next->move_from_last = Move(0, 0, Move::NULL_MOVE);
-	
-	// Contextualize position linking
-	const BoardComposite * orig = current;
-	BoardComposite * target = current->next;
+	target->move_from_last = Move(0, 0, Move::NULL_MOVE);
 	
-	// Decide which type of move to make
-	if (move.code == Move::NORMAL_MOVE) {
-		status = MakeNormal(orig, target, move);
-	}
-	else if (move.code == Move::EN_PASSANT) {
-		status = MakeEnPassant(orig, target, move);
-	}
-	else if (
-			move.code == Move::WHITE_OO || move.code == Move::WHITE_OOO ||
-			move.code == Move::BLACK_OO || move.code == Move::BLACK_OOO) {
-		status = MakeCastling(orig, target, move);
-	}
-	else if ((move.code >= WHITE_KNIGHT && move.code <= WHITE_QUEEN) || (move.code >= BLACK_KNIGHT && move.code <= BLACK_QUEEN)) {
-		status = MakePromotion(orig, target, move);
-	}
-	else {
-		std::cout << "Invalid Move Type" << std::endl;
-		return false;
-	}
+	// Make the move with the color to move fixed at compile time
+	if (orig->state.white_to_move) status = MakeMove<WHITE>(orig, target, move);
+	else status = MakeMove<BLACK>(orig, target, move);
 	
 	if (status) {
-		// Color to Move
+		// Color to Move; the hash is only changed here because castling and en
+		// passant are made in several steps
 		target->state.white_to_move = !orig->state.white_to_move;
+		target->hash ^= ZOBRIST_WHITE_TO_MOVE;
 		
 		// Move Cache
 		target->move_cache.Clear();
-		target->unmove_cache.Clear();
+		target->status.Clear();
 		
 		// Link moves
 		current->move_to_next = move;
-		current->next->move_from_last = move;
+		target->move_from_last = move;
 		
 		// Increment Current Position
-		current = current->next;
+		if (next_block) SetPlyBlock(block_index + 1);
+		current = target;
 		depth++;
+		
+		// Repetition keys
+		SetPlyKey(depth, target->hash);
 	}
 	
 	return status;
 }
 
+template <bool IS_WHITE>
+bool Board::MakeMove(const BoardComposite * orig, BoardComposite * target, Move move) {
+	// Decide which type of move to make
+	if (move.code == Move::NORMAL_MOVE) {
+		return MakeNormal<IS_WHITE>(orig, target, move);
+	}
+	else if (move.code == Move::EN_PASSANT) {
+		return MakeEnPassant<IS_WHITE>(orig, target, move);
+	}
+	else if (
+			move.code == Move::WHITE_OO || move.code == Move::WHITE_OOO ||
+			move.code == Move::BLACK_OO || move.code == Move::BLACK_OOO) {
+		return MakeCastling<IS_WHITE>(orig, target, move);
+	}
+	else if ((move.code >= WHITE_KNIGHT && move.code <= WHITE_QUEEN) || (move.code >= BLACK_KNIGHT && move.code <= BLACK_QUEEN)) {
+		return MakePromotion<IS_WHITE>(orig, target, move);
+	}
+	std::cout << "Invalid Move Type" << std::endl;
+	return false;
+}
+
+template <bool IS_WHITE>
 bool Board::MakeNormal(const BoardComposite * orig, BoardComposite * target, Move move) {
-	bool status = MakeComplete(orig, target, move.start, move.end,
+	bool status = MakeComplete<IS_WHITE>(orig, target, move.start, move.end,
 			orig->state.squares[move.start], orig->state.squares[move.end], orig->state.squares[move.start]);
 	if (!status) return false;
-	if (orig->state.squares[move.start] == WHITE_PAWN || orig->state.squares[move.start] == BLACK_PAWN || orig->state.squares[move.end] != EMPTY) {
+	if (orig->state.squares[move.start] == (IS_WHITE ? WHITE_PAWN : BLACK_PAWN) || orig->state.squares[move.end] != EMPTY) {
 		target->state.n_ply_without_progress = 0;
 	}
 	else {
@@ -98,58 +107,28 @@ bool Board::MakeNormal(const BoardComposite * orig, BoardComposite * target, Mov
 	return status;
 }
 
+template <bool IS_WHITE>
 bool Board::MakeCastling(const BoardComposite * orig, BoardComposite * target, Move move) {
-	static BoardComposite intermediate1, intermediate2;
+	// Squares are on the back rank of the color to move
+	const uint8_t rank = IS_WHITE ? 0 : 56;
+	const uint8_t king_piece = IS_WHITE ? WHITE_KING : BLACK_KING;
+	const uint8_t rook_piece = IS_WHITE ? WHITE_ROOK : BLACK_ROOK;
 	uint8_t king_start, king_inter, king_end, rook_start, rook_end;
-	uint8_t king_piece, rook_piece;
-	bool color;
-	if (move.code == Move::WHITE_OO) {
-		if (orig->state.white_to_move != true) return false;
-		king_start = 4;
-		king_inter = 5;
-		king_end = 6;
-		rook_start = 7;
-		rook_end = 5;
-		king_piece = WHITE_KING;
-		rook_piece = WHITE_ROOK;
-		color = true;
-	}
-	else if (move.code == Move::WHITE_OOO) {
-		if (orig->state.white_to_move != true) return false;
-		king_start = 4;
-		king_inter = 3;
-		king_end = 2;
-		rook_start = 0;
-		rook_end = 3;
-		king_piece = WHITE_KING;
-		rook_piece = WHITE_ROOK;
-		// Verify the extra empty square
-		if (orig->state.squares[1] != EMPTY) return false;
-		color = true;
+	if (move.code == (IS_WHITE ? Move::WHITE_OO : Move::BLACK_OO)) {
+		king_start = rank + 4;
+		king_inter = rank + 5;
+		king_end = rank + 6;
+		rook_start = rank + 7;
+		rook_end = rank + 5;
 	}
-	else if (move.code == Move::BLACK_OO) {
-		if (orig->state.white_to_move != false) return false;
-		king_start = 60;
-		king_inter = 61;
-		king_end = 62;
-		rook_start = 63;
-		rook_end = 61;
-		king_piece = BLACK_KING;
-		rook_piece = BLACK_ROOK;
-		color = false;
-	}
-	else if (move.code == Move::BLACK_OOO) {
-		if (orig->state.white_to_move != false) return false;
-		king_start = 60;
-		king_inter = 59;
-		king_end = 58;
-		rook_start = 56;
-		rook_end = 59;
-		king_piece = BLACK_KING;
-		rook_piece = BLACK_ROOK;
+	else if (move.code == (IS_WHITE ? Move::WHITE_OOO : Move::BLACK_OOO)) {
+		king_start = rank + 4;
+		king_inter = rank + 3;
+		king_end = rank + 2;
+		rook_start = rank + 0;
+		rook_end = rank + 3;
 		// Verify the extra empty square
-		if (orig->state.squares[57] != EMPTY) return false;
-		color = false;
+		if (orig->state.squares[rank + 1] != EMPTY) return false;
 	}
 	else {
 		return false;
@@ -167,14 +146,14 @@ bool Board::MakeCastling(const BoardComposite * orig, BoardComposite * target, M
 	
 	// Verify that the king is not in check while making the moves in sequence
 	bool status = true;
-	if (mgen.InCheck(orig, color)) return false;
-	status = MakeComplete(orig, &intermediate1, king_start, king_inter, king_piece, (uint8_t)EMPTY, king_piece);
+	if (mgen.InCheck<IS_WHITE>(orig)) return false;
+	status = MakeComplete<IS_WHITE>(orig, &intermediate[0], king_start, king_inter, king_piece, (uint8_t)EMPTY, king_piece);
 	if (!status) return status;
-	if (mgen.InCheck(&intermediate1, color)) return false;
-	status = MakeComplete(&intermediate1, &intermediate2, king_inter, king_end, king_piece, (uint8_t)EMPTY, king_piece);
+	if (mgen.InCheck<IS_WHITE>(&intermediate[0])) return false;
+	status = MakeComplete<IS_WHITE>(&intermediate[0], &intermediate[1], king_inter, king_end, king_piece, (uint8_t)EMPTY, king_piece);
 	if (!status) return status;
-	if (mgen.InCheck(&intermediate2, color)) return false;
-	status = MakeComplete(&intermediate2, target, rook_start, rook_end, rook_piece, (uint8_t)EMPTY, rook_piece);
+	if (mgen.InCheck<IS_WHITE>(&intermediate[1])) return false;
+	status = MakeComplete<IS_WHITE>(&intermediate[1], target, rook_start, rook_end, rook_piece, (uint8_t)EMPTY, rook_piece);
 	if (!status) return status;
 	
 	target->state.n_ply_without_progress = 0;
@@ -182,23 +161,13 @@ bool Board::MakeCastling(const BoardComposite * orig, BoardComposite * target, M
 	return status;
 }
 
+template <bool IS_WHITE>
 bool Board::MakeEnPassant(const BoardComposite * orig, BoardComposite * target, Move move) {
-	static BoardComposite intermediate;
-	uint8_t start, inter, end;
-	uint8_t friendly_pawn, enemy_pawn;
-	
-	start = move.start;
-	end = move.end;
-	if (orig->state.white_to_move) {
-		inter = move.end - 8;
-		friendly_pawn = WHITE_PAWN;
-		enemy_pawn = BLACK_PAWN;
-	}
-	else {
-		inter = move.end + 8;
-		friendly_pawn = BLACK_PAWN;
-		enemy_pawn = WHITE_PAWN;
-	}
+	const uint8_t friendly_pawn = IS_WHITE ? WHITE_PAWN : BLACK_PAWN;
+	const uint8_t enemy_pawn = IS_WHITE ? BLACK_PAWN : WHITE_PAWN;
+	uint8_t start = move.start;
+	uint8_t end = move.end;
+	uint8_t inter = IS_WHITE ? end - 8 : end + 8;
 	
 	// Verify that there is correct piece placement
 	if (orig->state.squares[start] != friendly_pawn || orig->state.squares[inter] != enemy_pawn || orig->state.squares[end] != EMPTY) {
@@ -206,9 +175,9 @@ bool Board::MakeEnPassant(const BoardComposite * orig, BoardComposite * target,
 	}
 	
 	bool status = true;
-	status = MakeComplete(orig, &intermediate, start, inter, friendly_pawn, enemy_pawn, friendly_pawn);
+	status = MakeComplete<IS_WHITE>(orig, &intermediate[0], start, inter, friendly_pawn, enemy_pawn, friendly_pawn);
 	if (!status) return status;
-	status = MakeComplete(&intermediate, target, inter, end, friendly_pawn, (uint8_t)EMPTY, friendly_pawn);
+	status = MakeComplete<IS_WHITE>(&intermediate[0], target, inter, end, friendly_pawn, (uint8_t)EMPTY, friendly_pawn);
 	if (!status) return status;
 	
 	target->state.n_ply_without_progress = 0;
@@ -216,14 +185,15 @@ bool Board::MakeEnPassant(const BoardComposite * orig, BoardComposite * target,
 	return true;
 }
 
+template <bool IS_WHITE>
 bool Board::MakePromotion(const BoardComposite * orig, BoardComposite * target, Move move) {
 	// Check that a pawn is making the move
-	if (orig->state.squares[move.start] != WHITE_PAWN && orig->state.squares[move.start] != BLACK_PAWN) {
+	if (orig->state.squares[move.start] != (IS_WHITE ? WHITE_PAWN : BLACK_PAWN)) {
 		std::cout << "Neither are pawns" << std::endl;
 		return false;
 	}
 	
-	bool status = MakeComplete(orig, target, move.start, move.end,
+	bool status = MakeComplete<IS_WHITE>(orig, target, move.start, move.end,
 			orig->state.squares[move.start], orig->state.squares[move.end], move.code);
 	if (!status) return false;
 	
@@ -232,6 +202,7 @@ bool Board::MakePromotion(const BoardComposite * orig, BoardComposite * target,
 	return status;
 }
 
+template <bool IS_WHITE>
 bool Board::MakeComplete(const BoardComposite * orig, BoardComposite * target,
 		uint8_t start, uint8_t end, uint8_t start_piece, uint8_t end_piece, uint8_t promotion_piece) {
 
@@ -244,7 +215,7 @@ bool Board::MakeComplete(const BoardComposite * orig, BoardComposite * target,
 	
 	// Cannot move a piece that does not belong to the color to move
 	// Cannot capture a piece that belongs to the color to move
-	if (orig->state.white_to_move) {
+	if (IS_WHITE) {
 		if (!(start_piece >= WHITE_PAWN && start_piece <= WHITE_KING)) std::cout << "Moving wrong colored piece" << std::endl;
 		if (!(start_piece >= WHITE_PAWN && start_piece <= WHITE_KING)) return false;
 		if (end_piece >= WHITE_PAWN && end_piece <= WHITE_KING) std::cout << "Capturing wrong colored piece" << std::endl;
@@ -267,35 +238,22 @@ bool Board::MakeComplete(const BoardComposite * orig, BoardComposite * target,
 	
 	// Bitboards
 	Bitboard_t factor = ((Bitboard_t)1 << end) | ((Bitboard_t)1 << start);
-	if (orig->state.white_to_move) {
+	if (IS_WHITE) {
 		target->white = orig->white ^ factor;
-		if (start_piece == WHITE_PAWN) {
-			target->wpawns = orig->wpawns ^ factor;
-			if (promotion_piece != WHITE_PAWN) {
-				target->wpawns &= ~factor;
-			}
-		}
-		else {
-			target->wpawns = orig->wpawns;
-		}
 		target->black = orig->black & ~factor;
-		target->bpawns = orig->bpawns & ~factor;
 	}
 	else {
 		target->black = orig->black ^ factor;
-		if (start_piece == BLACK_PAWN) {
-			target->bpawns = orig->bpawns ^ factor;
-			if (promotion_piece != BLACK_PAWN) {
-				target->bpawns &= ~factor;
-			}
-		}
-		else {
-			target->bpawns = orig->bpawns;
-		}
 		target->white = orig->white & ~factor;
-		target->wpawns = orig->wpawns & ~factor;
 	}
 	
+	// Piece Bitboards (mirrors the hash update below)
+	memcpy(target->pieces, orig->pieces, sizeof(target->pieces));
+	target->pieces[start_piece] ^= (Bitboard_t)1 << start;
+	target->pieces[EMPTY] ^= (Bitboard_t)1 << start;
+	target->pieces[end_piece] ^= (Bitboard_t)1 << end;
+	target->pieces[promotion_piece] ^= (Bitboard_t)1 << end;
+	
 	// King Positions
 	target->wking_pos = start_piece == WHITE_KING ? end : orig->wking_pos;
 	target->bking_pos = start_piece == BLACK_KING ? end : orig->bking_pos;
@@ -343,23 +301,239 @@ bool Board::MakeComplete(const BoardComposite * orig, BoardComposite * target,
 		^ ZOBRIST_BLACK_OOO[orig->state.black_OOO]
 		// En Passant
 		^ ZOBRIST_EN_PASSANT[target->state.ep_target]
-		^ ZOBRIST_EN_PASSANT[orig->state.ep_target]
-		// Color
-		^ ZOBRIST_WHITE_TO_MOVE;
+		^ ZOBRIST_EN_PASSANT[orig->state.ep_target];
 		
 	// Transfer color to next
-	target->state.white_to_move = orig->state.white_to_move;
+	target->state.white_to_move = IS_WHITE;
 	
 	return true;
 }
 
 bool Board::Unmake(uint16_t n_moves) {
 	for (int i = 0; i < n_moves; i++) {
-		if (current->last) {
-			current = current->last;
-			depth--;
+		if (depth > 0) ClearPlyKey(depth);
+		if (current != block_begin) current--;
+		else if (block_index > 0) {
+			SetPlyBlock(block_index - 1);
+			current = block_end - 1;
 		}
 		else return false;
+		depth--;
 	}
 	return true;
-}
\ No newline at end of file
+}
+
+/**
+ * In-Place Move Making
+ * 
+ * Only the squares that a move touches are rewritten; the bitboards, piece
+ * bitboards, king positions, roster and hash are updated along with each
+ * square. Everything else that a move changes is saved in an undo record.
+ */
+
+// Put a piece (or EMPTY) on a square, replacing whatever was there
+static inline void SetSquare(BoardComposite * board, uint8_t square, uint8_t piece) {
+	uint8_t old_piece = board->state.squares[square];
+	Bitboard_t bit = (Bitboard_t)1 << square;
+	board->state.squares[square] = piece;
+	
+	// Bitboards
+	if (old_piece >= WHITE_PAWN && old_piece <= WHITE_KING) board->white ^= bit;
+	else if (old_piece >= BLACK_PAWN && old_piece <= BLACK_KING) board->black ^= bit;
+	if (piece >= WHITE_PAWN && piece <= WHITE_KING) board->white ^= bit;
+	else if (piece >= BLACK_PAWN && piece <= BLACK_KING) board->black ^= bit;
+	
+	// Piece Bitboards and Piece Roster
+	board->pieces[old_piece] ^= bit;
+	board->pieces[piece] ^= bit;
+	board->roster[old_piece]--;
+	board->roster[piece]++;
+	
+	// King Positions
+	if (piece == WHITE_KING) board->wking_pos = square;
+	else if (piece == BLACK_KING) board->bking_pos = square;
+	
+	// Hash
+	board->hash ^= ZOBRIST_SQUARES[old_piece][square] ^ ZOBRIST_SQUARES[piece][square];
+}
+
+bool Board::MakeInPlace(Move move, Undo * undo) {
+	bool status;
+	if (current->state.white_to_move) status = MakeInPlace<WHITE>(current, move, undo);
+	else status = MakeInPlace<BLACK>(current, move, undo);
+	
+	// Repetition keys
+	if (status) {
+		in_place_depth++;
+		SetPlyKey(depth + in_place_depth, current->hash);
+	}
+	return status;
+}
+
+void Board::UnmakeInPlace(const Undo & undo) {
+	// Repetition keys
+	ClearPlyKey(depth + in_place_depth);
+	in_place_depth--;
+	
+	// The color that made the move is no longer the color to move
+	if (current->state.white_to_move) UnmakeInPlace<BLACK>(current, undo);
+	else UnmakeInPlace<WHITE>(current, undo);
+}
+
+template <bool IS_WHITE>
+bool Board::MakeInPlace(BoardComposite * board, Move move, Undo * undo) {
+	const uint8_t friendly_pawn = IS_WHITE ? WHITE_PAWN : BLACK_PAWN;
+	const uint8_t enemy_pawn = IS_WHITE ? BLACK_PAWN : WHITE_PAWN;
+	const uint8_t friendly_king = IS_WHITE ? WHITE_KING : BLACK_KING;
+	const uint8_t friendly_rook = IS_WHITE ? WHITE_ROOK : BLACK_ROOK;
+	const uint8_t friendly_min = IS_WHITE ? WHITE_PAWN : BLACK_PAWN;
+	const uint8_t friendly_max = IS_WHITE ? WHITE_KING : BLACK_KING;
+	BoardState & state = board->state;
+	
+	// Save the state that cannot be recovered by reversing the move
+	undo->move = move;
+	undo->captured = EMPTY;
+	undo->white_OO = state.white_OO;
+	undo->white_OOO = state.white_OOO;
+	undo->black_OO = state.black_OO;
+	undo->black_OOO = state.black_OOO;
+	undo->ep_target = state.ep_target;
+	undo->n_ply_without_progress = state.n_ply_without_progress;
+	undo->hash = board->hash;
+	
+	bool progress = true;
+	bool is_promotion = (move.code >= WHITE_KNIGHT && move.code <= WHITE_QUEEN) || (move.code >= BLACK_KNIGHT && move.code <= BLACK_QUEEN);
+	if (move.code == Move::NORMAL_MOVE || is_promotion) {
+		uint8_t start_piece = state.squares[move.start];
+		uint8_t end_piece = state.squares[move.end];
+		
+		// Same conditions as for moves that are copied
+		if (!(start_piece >= friendly_min && start_piece <= friendly_max)) return false;
+		if (end_piece >= friendly_min && end_piece <= friendly_max) return false;
+		if (end_piece == WHITE_KING || end_piece == BLACK_KING) return false;
+		if (is_promotion && start_piece != friendly_pawn) return false;
+		
+		undo->captured = end_piece;
+		progress = start_piece == friendly_pawn || end_piece != EMPTY;
+		SetSquare(board, move.end, is_promotion ? (uint8_t)move.code : start_piece);
+		SetSquare(board, move.start, EMPTY);
+	}
+	else if (move.code == Move::EN_PASSANT) {
+		uint8_t inter = IS_WHITE ? move.end - 8 : move.end + 8;
+		if (state.squares[move.start] != friendly_pawn || state.squares[inter] != enemy_pawn || state.squares[move.end] != EMPTY) {
+			return false;
+		}
+		
+		undo->captured = enemy_pawn;
+		SetSquare(board, move.end, friendly_pawn);
+		SetSquare(board, move.start, EMPTY);
+		SetSquare(board, inter, EMPTY);
+	}
+	else if (move.code == (IS_WHITE ? Move::WHITE_OO : Move::BLACK_OO) || move.code == (IS_WHITE ? Move::WHITE_OOO : Move::BLACK_OOO)) {
+		const uint8_t rank = IS_WHITE ? 0 : 56;
+		bool is_short = move.code == (IS_WHITE ? Move::WHITE_OO : Move::BLACK_OO);
+		uint8_t king_start = rank + 4;
+		uint8_t king_inter = is_short ? rank + 5 : rank + 3;
+		uint8_t king_end = is_short ? rank + 6 : rank + 2;
+		uint8_t rook_start = is_short ? rank + 7 : rank + 0;
+		
+		// Verify piece placement and empty squares
+		if (state.squares[king_start] != friendly_king || state.squares[rook_start] != friendly_rook) return false;
+		if (state.squares[king_inter] != EMPTY || state.squares[king_end] != EMPTY) return false;
+		if (!is_short && state.squares[rank + 1] != EMPTY) return false;
+		
+		// Walk the king across one square at a time to verify that it does not
+		// begin in, travel through, or land in check
+		if (mgen.InCheck<IS_WHITE>(board)) return false;
+		SetSquare(board, king_inter, friendly_king);
+		SetSquare(board, king_start, EMPTY);
+		bool safe = !mgen.InCheck<IS_WHITE>(board);
+		SetSquare(board, king_end, friendly_king);
+		SetSquare(board, king_inter, EMPTY);
+		if (!safe || mgen.InCheck<IS_WHITE>(board)) {
+			SetSquare(board, king_start, friendly_king);
+			SetSquare(board, king_end, EMPTY);
+			return false;
+		}
+		SetSquare(board, king_inter, friendly_rook);
+		SetSquare(board, rook_start, EMPTY);
+	}
+	else {
+		std::cout << "Invalid Move Type" << std::endl;
+		return false;
+	}
+	
+	// En Passant
+	if (move.code == Move::NORMAL_MOVE && state.squares[move.end] == friendly_pawn &&
+			(IS_WHITE ? move.end - move.start == 16 : move.start - move.end == 16)) {
+		state.ep_target = move.end;
+	}
+	else {
+		state.ep_target = 0;
+	}
+	
+	// Castling Rights
+	state.white_OO = state.white_OO && state.squares[4] == WHITE_KING && state.squares[7] == WHITE_ROOK;
+	state.white_OOO = state.white_OOO && state.squares[4] == WHITE_KING && state.squares[0] == WHITE_ROOK;
+	state.black_OO = state.black_OO && state.squares[60] == BLACK_KING && state.squares[63] == BLACK_ROOK;
+	state.black_OOO = state.black_OOO && state.squares[60] == BLACK_KING && state.squares[56] == BLACK_ROOK;
+	
+	// Hash (squares have already been hashed)
+	board->hash ^= ZOBRIST_WHITE_OO[state.white_OO] ^ ZOBRIST_WHITE_OO[undo->white_OO]
+		^ ZOBRIST_WHITE_OOO[state.white_OOO] ^ ZOBRIST_WHITE_OOO[undo->white_OOO]
+		^ ZOBRIST_BLACK_OO[state.black_OO] ^ ZOBRIST_BLACK_OO[undo->black_OO]
+		^ ZOBRIST_BLACK_OOO[state.black_OOO] ^ ZOBRIST_BLACK_OOO[undo->black_OOO]
+		^ ZOBRIST_EN_PASSANT[state.ep_target] ^ ZOBRIST_EN_PASSANT[undo->ep_target]
+		^ ZOBRIST_WHITE_TO_MOVE;
+	
+	// Color to Move and Moves Without Progress
+	state.white_to_move = !IS_WHITE;
+	state.n_ply_without_progress = progress ? 0 : state.n_ply_without_progress + 1;
+	
+	// Move Cache
+	board->move_cache.Clear();
+	board->status.Clear();
+	
+	return true;
+}
+
+template <bool IS_WHITE>
+void Board::UnmakeInPlace(BoardComposite * board, const Undo & undo) {
+	const uint8_t friendly_pawn = IS_WHITE ? WHITE_PAWN : BLACK_PAWN;
+	BoardState & state = board->state;
+	Move move = undo.move;
+	
+	if (move.code == Move::EN_PASSANT) {
+		SetSquare(board, move.start, friendly_pawn);
+		SetSquare(board, move.end, EMPTY);
+		SetSquare(board, IS_WHITE ? move.end - 8 : move.end + 8, undo.captured);
+	}
+	else if (move.code == (IS_WHITE ? Move::WHITE_OO : Move::BLACK_OO) || move.code == (IS_WHITE ? Move::WHITE_OOO : Move::BLACK_OOO)) {
+		const uint8_t rank = IS_WHITE ? 0 : 56;
+		bool is_short = move.code == (IS_WHITE ? Move::WHITE_OO : Move::BLACK_OO);
+		SetSquare(board, rank + 4, IS_WHITE ? WHITE_KING : BLACK_KING);
+		SetSquare(board, is_short ? rank + 6 : rank + 2, EMPTY);
+		SetSquare(board, is_short ? rank + 7 : rank + 0, IS_WHITE ? WHITE_ROOK : BLACK_ROOK);
+		SetSquare(board, is_short ? rank + 5 : rank + 3, EMPTY);
+	}
+	else {
+		// Promotions turn back into a pawn
+		bool is_promotion = move.code != Move::NORMAL_MOVE;
+		SetSquare(board, move.start, is_promotion ? friendly_pawn : state.squares[move.end]);
+		SetSquare(board, move.end, undo.captured);
+	}
+	
+	// Restore the saved state
+	state.white_to_move = IS_WHITE;
+	state.white_OO = undo.white_OO;
+	state.white_OOO = undo.white_OOO;
+	state.black_OO = undo.black_OO;
+	state.black_OOO = undo.black_OOO;
+	state.ep_target = undo.ep_target;
+	state.n_ply_without_progress = undo.n_ply_without_progress;
+	board->hash = undo.hash;
+	
+	// Move Cache
+	board->move_cache.Clear();
+	board->status.Clear();
+}
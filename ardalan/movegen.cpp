@@ -1,7 +1,15 @@
 #include "datatypes.h"
+#include "magic.h"
 #include "movegen.h"
 
+#include <algorithm>
 #include <iostream>
+#include <mutex>
+#include <thread>
+
+#ifdef ARDALAN_SIMD_EMIT
+#include <immintrin.h>
+#endif
 
 #if 0
 static void PrintBitboard(Bitboard_t x) {
@@ -16,7 +24,11 @@ static void PrintBitboard(Bitboard_t x) {
 #endif
 
 MoveGenerator::MoveGenerator() {
-	Init();
+	// The tables are shared by every generator and never change, so only the
+	// first generator builds them; std::call_once also makes this safe when
+	// boards are constructed on several threads at once
+	static std::once_flag tables_initialized;
+	std::call_once(tables_initialized, &MoveGenerator::Init, this);
 }
 
 MoveList MoveGenerator::GetMoves(const BoardComposite * board) {
@@ -26,122 +38,181 @@ MoveList MoveGenerator::GetMoves(const BoardComposite * board) {
 }
 
 void MoveGenerator::GetMoves(const BoardComposite * board, MoveList * output) {
-	Bitboard_t friendly, enemy;
-	uint8_t piece;
+	GenerateMoves(board, output, false, ALL_MOVES, ~(Bitboard_t)0);
+}
+
+MoveList MoveGenerator::GetLegalMoves(const BoardComposite * board) {
+	MoveList output;
+	GetLegalMoves(board, &output);
+	return output;
+}
+
+void MoveGenerator::GetLegalMoves(const BoardComposite * board, MoveList * output) {
+	GenerateMoves(board, output, true, ALL_MOVES, ~(Bitboard_t)0);
+}
+
+void MoveGenerator::GetLegalMoves(const BoardComposite * board, MoveList * output, uint8_t kinds, Bitboard_t from) {
+	GenerateMoves(board, output, true, kinds, from);
+}
+
+void MoveGenerator::GetCaptures(const BoardComposite * board, MoveList * output) {
+	GenerateMoves(board, output, true, CAPTURES, ~(Bitboard_t)0);
+}
+
+void MoveGenerator::GetEvasions(const BoardComposite * board, MoveList * output) {
+	GenerateMoves(board, output, true, ALL_MOVES | EVASIONS, ~(Bitboard_t)0);
+}
+
+void MoveGenerator::GetQuietChecks(const BoardComposite * board, MoveList * output) {
+	GenerateMoves(board, output, true, QUIETS | QUIET_CHECKS, ~(Bitboard_t)0);
+}
+
+template <bool IS_WHITE>
+void MoveGenerator::GetMoves(const BoardComposite * board, MoveList * output) {
+	GenerateMoves<IS_WHITE>(board, output, false, ALL_MOVES, ~(Bitboard_t)0);
+}
+
+template <bool IS_WHITE>
+void MoveGenerator::GetLegalMoves(const BoardComposite * board, MoveList * output) {
+	GenerateMoves<IS_WHITE>(board, output, true, ALL_MOVES, ~(Bitboard_t)0);
+}
+
+int MoveGenerator::GenerateMoves(const BoardComposite * board, MoveList * output, bool legal, uint8_t kinds, Bitboard_t from) {
+	if (board->state.white_to_move) return GenerateMoves<WHITE>(board, output, legal, kinds, from);
+	else return GenerateMoves<BLACK>(board, output, legal, kinds, from);
+}
+
+template <bool IS_WHITE>
+int MoveGenerator::GenerateMoves(const BoardComposite * board, MoveList * output, bool legal, uint8_t kinds, Bitboard_t from) {
+	Bitboard_t friendly = IS_WHITE ? board->white : board->black;
+	Bitboard_t enemy = IS_WHITE ? board->black : board->white;
+	Bitboard_t all = friendly | enemy;
 	
-	static int coord_lists_squares[256];
-	static CoordList coord_lists[256];
-	int n_coord_lists = 0;
+	// Piece codes of the color to move are offset from the white codes
+	const uint8_t color = IS_WHITE ? 0 : 8;
 	
-	static int prom_coord_lists_squares[8];
-	static CoordList prom_coord_lists[8];
-	int n_prom_coord_lists = 0;
+	// Legality masks; these allow everything for pseudo-legal generation
+	//		evasions: squares that resolve a single check (block or capture)
+	//		pinned: pieces that may only move along the line to their king
+	uint8_t king = IS_WHITE ? board->wking_pos : board->bking_pos;
+	Bitboard_t checkers = 0;
+	Bitboard_t evasions = ~(Bitboard_t)0;
+	Bitboard_t pinned = 0;
+	if (king >= 64) {
+		// Without a king, every pseudo-legal move is legal
+		legal = false;
+	}
+	if (legal) {
+		checkers = GetAttackers<!IS_WHITE>(board, king, all);
+		evasions = GetEvasionSquares(king, checkers);
+		pinned = GetPinned<IS_WHITE>(board, king);
+	}
+	if ((kinds & EVASIONS) && !checkers) {
+		// Nothing to evade, so no pieces may move
+		from = 0;
+	}
 	
-	if (board->state.white_to_move)
-	{
-		friendly = board->white;
-		enemy = board->black;
-		
-		for (int square = 0; square < 64; square++) {
-			
-			piece = board->state.squares[square];
-			
-			if (piece == EMPTY || piece > 8) continue;
-
-			if (piece == WHITE_PAWN) {
-				// Check for promotion
-				if (square / 8 == 6) {
-					prom_coord_lists[n_prom_coord_lists] = GetWPMoves(friendly, enemy, square);
-					prom_coord_lists_squares[n_prom_coord_lists++] = square;
-				} else {
-					coord_lists[n_coord_lists] = GetWPMoves(friendly, enemy, square);
-					coord_lists_squares[n_coord_lists++] = square;
-				}
-			}
-			else if (piece == WHITE_KNIGHT) {
-				coord_lists[n_coord_lists] = GetNMoves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-			}
-			else if (piece == WHITE_BISHOP) {
-				coord_lists[n_coord_lists] = GetD1Moves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-				coord_lists[n_coord_lists] = GetD2Moves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-			}
-			else if (piece == WHITE_ROOK) {
-				coord_lists[n_coord_lists] = GetHMoves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-				coord_lists[n_coord_lists] = GetVMoves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-			}
-			else if (piece == WHITE_QUEEN) {
-				coord_lists[n_coord_lists] = GetD1Moves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-				coord_lists[n_coord_lists] = GetD2Moves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-				coord_lists[n_coord_lists] = GetHMoves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-				coord_lists[n_coord_lists] = GetVMoves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-			}
-			else if (piece == WHITE_KING) {
-				coord_lists[n_coord_lists] = GetKMoves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-			}
+	// Restrict the target squares of normal moves to the requested kinds; for
+	// quiet checks, a piece may only move quietly to a square from which it
+	// attacks the enemy king, or off the line of a check that it uncovers
+	Bitboard_t capture_mask = (kinds & CAPTURES) ? enemy : 0;
+	Bitboard_t quiet_mask = (kinds & QUIETS) ? ~all : 0;
+	Bitboard_t kind_masks[8];
+	CheckInfo check_info;
+	if (kinds & QUIET_CHECKS) {
+		GetCheckInfo<IS_WHITE>(board, &check_info);
+		for (int i = 0; i < 8; i++) {
+			kind_masks[i] = capture_mask | (quiet_mask & check_info.check_squares[i]);
 		}
 	}
-	else
-	{
-		friendly = board->black;
-		enemy = board->white;
-		
-		for (int square = 0; square < 64; square++) {
-			
-			piece = board->state.squares[square];
-			
-			if (piece == EMPTY || piece < 8) continue;
-
-			if (piece == BLACK_PAWN) {
-				// Check for promotion
-				if (square / 8 == 1) {
-					prom_coord_lists[n_prom_coord_lists] = GetBPMoves(friendly, enemy, square);
-					prom_coord_lists_squares[n_prom_coord_lists++] = square;
-				} else {
-					coord_lists[n_coord_lists] = GetBPMoves(friendly, enemy, square);
-					coord_lists_squares[n_coord_lists++] = square;
+	else {
+		check_info.discovered = 0;
+		for (int i = 0; i < 8; i++) {
+			kind_masks[i] = capture_mask | quiet_mask;
+		}
+	}
+	
+	uint8_t target_lists_squares[64];
+	Bitboard_t target_lists[64];
+	int n_target_lists = 0;
+	
+	uint8_t prom_target_lists_squares[64];
+	Bitboard_t prom_target_lists[64];
+	int n_prom_target_lists = 0;
+	
+	// Iterate over the pieces of the color to move only, so that the cost
+	// depends on the number of pieces instead of the number of squares
+	Bitboard_t pieces;
+	uint8_t square;
+	
+	pieces = board->pieces[WHITE_PAWN + color] & from;
+	while (pieces) {
+		square = PopLSB(pieces);
+		Bitboard_t targets = GetPTargets<IS_WHITE>(all, enemy, square) & evasions;
+		if (pinned & ((Bitboard_t)1 << square)) targets &= line_masks[king][square];
+		// Check for promotion
+		if (square / 8 == (IS_WHITE ? 6 : 1)) {
+			if (!(kinds & (CAPTURES | UNDERPROMOTIONS))) continue;
+			prom_target_lists[n_prom_target_lists] = targets;
+			prom_target_lists_squares[n_prom_target_lists++] = square;
+		} else {
+			target_lists[n_target_lists] = targets & (kind_masks[WHITE_PAWN] | GetDiscoveryTargets(check_info, square, quiet_mask));
+			target_lists_squares[n_target_lists++] = square;
+		}
+	}
+	pieces = board->pieces[WHITE_KNIGHT + color] & from;
+	while (pieces) {
+		square = PopLSB(pieces);
+		Bitboard_t targets = n_masks[square] & (kind_masks[WHITE_KNIGHT] | GetDiscoveryTargets(check_info, square, quiet_mask));
+		targets &= evasions;
+		if (pinned & ((Bitboard_t)1 << square)) targets &= line_masks[king][square];
+		target_lists[n_target_lists] = targets;
+		target_lists_squares[n_target_lists++] = square;
+	}
+	pieces = board->pieces[WHITE_BISHOP + color] & from;
+	while (pieces) {
+		square = PopLSB(pieces);
+		Bitboard_t targets = GetBAttacks(all, square) & (kind_masks[WHITE_BISHOP] | GetDiscoveryTargets(check_info, square, quiet_mask));
+		targets &= evasions;
+		if (pinned & ((Bitboard_t)1 << square)) targets &= line_masks[king][square];
+		target_lists[n_target_lists] = targets;
+		target_lists_squares[n_target_lists++] = square;
+	}
+	pieces = board->pieces[WHITE_ROOK + color] & from;
+	while (pieces) {
+		square = PopLSB(pieces);
+		Bitboard_t targets = GetRAttacks(all, square) & (kind_masks[WHITE_ROOK] | GetDiscoveryTargets(check_info, square, quiet_mask));
+		targets &= evasions;
+		if (pinned & ((Bitboard_t)1 << square)) targets &= line_masks[king][square];
+		target_lists[n_target_lists] = targets;
+		target_lists_squares[n_target_lists++] = square;
+	}
+	pieces = board->pieces[WHITE_QUEEN + color] & from;
+	while (pieces) {
+		square = PopLSB(pieces);
+		Bitboard_t targets = GetQAttacks(all, square) & (kind_masks[WHITE_QUEEN] | GetDiscoveryTargets(check_info, square, quiet_mask));
+		targets &= evasions;
+		if (pinned & ((Bitboard_t)1 << square)) targets &= line_masks[king][square];
+		target_lists[n_target_lists] = targets;
+		target_lists_squares[n_target_lists++] = square;
+	}
+	pieces = board->pieces[WHITE_KING + color] & from;
+	while (pieces) {
+		square = PopLSB(pieces);
+		Bitboard_t targets = k_masks[square] & (kind_masks[WHITE_KING] | GetDiscoveryTargets(check_info, square, quiet_mask));
+		if (legal) {
+			// The king cannot move to an attacked square, and must not block
+			// the attack on the square behind it along a checking line
+			Bitboard_t king_targets = targets;
+			while (king_targets) {
+				uint8_t target = PopLSB(king_targets);
+				if (GetAttackers<!IS_WHITE>(board, target, all ^ ((Bitboard_t)1 << square))) {
+					targets &= ~((Bitboard_t)1 << target);
 				}
 			}
-			else if (piece == BLACK_KNIGHT) {
-				coord_lists[n_coord_lists] = GetNMoves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-			}
-			else if (piece == BLACK_BISHOP) {
-				coord_lists[n_coord_lists] = GetD1Moves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-				coord_lists[n_coord_lists] = GetD2Moves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-			}
-			else if (piece == BLACK_ROOK) {
-				coord_lists[n_coord_lists] = GetHMoves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-				coord_lists[n_coord_lists] = GetVMoves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-			}
-			else if (piece == BLACK_QUEEN) {
-				coord_lists[n_coord_lists] = GetD1Moves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-				coord_lists[n_coord_lists] = GetD2Moves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-				coord_lists[n_coord_lists] = GetHMoves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-				coord_lists[n_coord_lists] = GetVMoves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-			}
-			else if (piece == BLACK_KING) {
-				coord_lists[n_coord_lists] = GetKMoves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-			}
 		}
+		target_lists[n_target_lists] = targets;
+		target_lists_squares[n_target_lists++] = square;
 	}
 	
 	Move special_moves[6];
@@ -151,27 +222,32 @@ void MoveGenerator::GetMoves(const BoardComposite * board, MoveList * output) {
 	//		1. Castling must be available
 	//		2. King and rook are in correct place
 	//		3. No pieces between king and rook
-	Bitboard_t all = friendly | enemy;
-	if (board->state.white_to_move) {
+	//		4. (Legal only) King does not start in, pass through, or land in check
+	bool can_castle = !checkers;
+	if (IS_WHITE) {
 		if (board->state.white_OO && board->state.squares[4] == WHITE_KING
-				&& board->state.squares[7] == WHITE_ROOK && !(all & 0x0000000000000060))
+				&& board->state.squares[7] == WHITE_ROOK && !(all & 0x0000000000000060)
+				&& (!legal || (can_castle && !GetAttackers<BLACK>(board, 5, all) && !GetAttackers<BLACK>(board, 6, all))))
 		{
 			special_moves[0].code = Move::WHITE_OO;
 		}
 		if (board->state.white_OOO && board->state.squares[4] == WHITE_KING
-				&& board->state.squares[0] == WHITE_ROOK && !(all & 0x000000000000000e))
+				&& board->state.squares[0] == WHITE_ROOK && !(all & 0x000000000000000e)
+				&& (!legal || (can_castle && !GetAttackers<BLACK>(board, 3, all) && !GetAttackers<BLACK>(board, 2, all))))
 		{ 
 			special_moves[1].code = Move::WHITE_OOO;
 		}
 	}
 	else {
 		if (board->state.black_OO && board->state.squares[60] == BLACK_KING
-				&& board->state.squares[63] == BLACK_ROOK && !(all & 0x6000000000000000))
+				&& board->state.squares[63] == BLACK_ROOK && !(all & 0x6000000000000000)
+				&& (!legal || (can_castle && !GetAttackers<WHITE>(board, 61, all) && !GetAttackers<WHITE>(board, 62, all))))
 		{
 			special_moves[2].code = Move::BLACK_OO;
 		}
 		if (board->state.black_OOO && board->state.squares[60] == BLACK_KING
-				&& board->state.squares[56] == BLACK_ROOK && !(all & 0x0e00000000000000))
+				&& board->state.squares[56] == BLACK_ROOK && !(all & 0x0e00000000000000)
+				&& (!legal || (can_castle && !GetAttackers<WHITE>(board, 59, all) && !GetAttackers<WHITE>(board, 58, all))))
 		{
 			special_moves[3].code = Move::BLACK_OOO;
 		}
@@ -181,104 +257,86 @@ void MoveGenerator::GetMoves(const BoardComposite * board, MoveList * output) {
 	// Conditions:
 	// 		1. En passant target must be set
 	//		2. Target square must be not on edge of board
-	//		3. Square adjacent to target must be a pawn of the opposite color
+	//		3. Square adjacent to target must be a pawn of the color to move
 	if (board->state.ep_target) {
+		uint8_t ep_target = board->state.ep_target;
+		uint8_t ep_end = IS_WHITE ? ep_target + 8 : ep_target - 8;
 		// Check for pawn to the right of the target
-		if (board->state.ep_target % 8 != 7) {
-			if (board->state.white_to_move
-					&& board->state.squares[board->state.ep_target + 1] == WHITE_PAWN)
-			{
-				special_moves[4].start = board->state.ep_target + 1;
-				special_moves[4].end = board->state.ep_target + 8;
-				special_moves[4].code = Move::EN_PASSANT;
-			}
-			else if (!board->state.white_to_move
-					&& board->state.squares[board->state.ep_target + 1] == BLACK_PAWN)
-			{
-				special_moves[4].start = board->state.ep_target + 1;
-				special_moves[4].end = board->state.ep_target - 8;
-				special_moves[4].code = Move::EN_PASSANT;
-			}
+		if (ep_target % 8 != 7 && board->state.squares[ep_target + 1] == WHITE_PAWN + color) {
+			special_moves[4].start = ep_target + 1;
+			special_moves[4].end = ep_end;
+			special_moves[4].code = Move::EN_PASSANT;
 		}
 		// Check for pawn to the left of the target
-		if (board->state.ep_target % 8 != 0) {
-			if (board->state.white_to_move 
-					&& board->state.squares[board->state.ep_target - 1] == WHITE_PAWN)
-			{
-				special_moves[5].start = board->state.ep_target - 1;
-				special_moves[5].end = board->state.ep_target + 8;
-				special_moves[5].code = Move::EN_PASSANT;
-			}
-			else if (!board->state.white_to_move 
-					&& board->state.squares[board->state.ep_target - 1] == BLACK_PAWN) 
-			{
-				special_moves[5].start = board->state.ep_target - 1;
-				special_moves[5].end = board->state.ep_target - 8;
-				special_moves[5].code = Move::EN_PASSANT;
-			}
+		if (ep_target % 8 != 0 && board->state.squares[ep_target - 1] == WHITE_PAWN + color) {
+			special_moves[5].start = ep_target - 1;
+			special_moves[5].end = ep_end;
+			special_moves[5].code = Move::EN_PASSANT;
 		}
 	}
 	
-	// Allocate Memory
-	uint16_t n_alloc = (n_coord_lists + n_prom_coord_lists) * 8 + 6;
-	if (output->moves) {
-		// If there is not enough memory, free and allocate later
-		if (output->n_alloc < n_alloc) {
-			delete[] output->moves;
-			output->moves = NULL;
-			output->n_moves = 0;
-			output->n_alloc = 0;
+	// Castling is counted as a quiet move and en passant as a capture
+	for (int i = 0; i < 6; i++) {
+		if (special_moves[i].code == Move::NULL_MOVE) continue;
+		bool is_castling = i < 4;
+		uint8_t start = is_castling ? (IS_WHITE ? 4 : 60) : special_moves[i].start;
+		if (!(kinds & (is_castling ? QUIETS : CAPTURES)) || !(from & ((Bitboard_t)1 << start))) {
+			special_moves[i].code = Move::NULL_MOVE;
+		}
+		else if (is_castling && (kinds & QUIET_CHECKS) && !GivesCheck<IS_WHITE>(board, special_moves[i], check_info)) {
+			special_moves[i].code = Move::NULL_MOVE;
 		}
 	}
-	// Allocate fresh/new memory
-	if (!output->moves) {
-		output->moves = new Move[n_alloc];
-		output->n_moves = 0;
-		output->n_alloc = n_alloc;
+	
+	// En passant captures remove two pieces from the capturing rank, so rather
+	// than reasoning about pins, check the king directly after the capture
+	if (legal) {
+		for (int i = 4; i < 6; i++) {
+			if (special_moves[i].code != Move::EN_PASSANT) continue;
+			Bitboard_t after = all
+				^ ((Bitboard_t)1 << special_moves[i].start)
+				^ ((Bitboard_t)1 << board->state.ep_target)
+				^ ((Bitboard_t)1 << special_moves[i].end);
+			if (GetAttackers<!IS_WHITE>(board, king, after) & after) {
+				special_moves[i].code = Move::NULL_MOVE;
+			}
+		}
+	}
+	
+	// The list has a fixed capacity that only positions which cannot arise in a
+	// game could exceed; moves that do not fit are dropped, and the count is
+	// limited the same way so that it always matches the list
+	int n_promotions = ((kinds & CAPTURES) ? 1 : 0) + ((kinds & UNDERPROMOTIONS) ? 3 : 0);
+	bool truncated = false;
+	int capacity = MoveList::MAX_MOVES - 6;
+	capacity -= LimitTargets(target_lists, n_target_lists, capacity, 1, &truncated);
+	capacity -= LimitTargets(prom_target_lists, n_prom_target_lists, capacity, n_promotions, &truncated);
+	
+	// Without an output list, only count the moves
+	if (!output) {
+		int n_moves = MoveList::MAX_MOVES - 6 - capacity;
+		for (int i = 0; i < 6; i++) {
+			n_moves += special_moves[i].code != Move::NULL_MOVE;
+		}
+		return n_moves;
 	}
 	
 	// Get variables for assigning output
 	Move * move_list = output->moves;
-	uint16_t n_moves = 0;
+	Move * move_i = move_list;
 	
 	// Normal Moves
-	for (int i = 0; i < n_coord_lists; i++) {
-		//std::cout << (int)coord_lists_squares[i] << ": " << coord_lists[i] << std::endl;
-		
-		for (int j = 0; j < 8; j++) {
-			move_list[n_moves].start = coord_lists_squares[i];
-			move_list[n_moves].end = coord_lists[i].coords[j];
-			move_list[n_moves].code = Move::NORMAL_MOVE;
-			
-			n_moves += coord_lists[i].coords[j] < 64;
-		}
-	}
+	move_i = EmitMoves(move_i, target_lists_squares, target_lists, n_target_lists, Move::NORMAL_MOVE);
 	// Promotion Moves
-	for (int i = 0; i < n_prom_coord_lists; i++) {
-		//std::cout << (int)prom_coord_lists_squares[i] << ": " << prom_coord_lists[i] << std::endl;
-		
-		for (int j = 0; j < 8; j++) {
-			if (board->state.white_to_move) {
-				for (int piece = WHITE_KNIGHT; piece <= WHITE_QUEEN; piece++) {
-					move_list[n_moves].start = prom_coord_lists_squares[i];
-					move_list[n_moves].end = prom_coord_lists[i].coords[j];
-					move_list[n_moves].code = piece;
-					
-					n_moves += prom_coord_lists[i].coords[j] < 64;
-				}
-			}
-			else {
-				for (int piece = BLACK_KNIGHT; piece <= BLACK_QUEEN; piece++) {
-					move_list[n_moves].start = prom_coord_lists_squares[i];
-					move_list[n_moves].end = prom_coord_lists[i].coords[j];
-					move_list[n_moves].code = piece;
-					
-					n_moves += prom_coord_lists[i].coords[j] < 64;
-				}
-			}
+	if (n_prom_target_lists) {
+		int first = (kinds & UNDERPROMOTIONS) ? WHITE_KNIGHT : WHITE_QUEEN;
+		int last = (kinds & CAPTURES) ? WHITE_QUEEN : WHITE_ROOK;
+		for (int piece = first; piece <= last; piece++) {
+			move_i = EmitMoves(move_i, prom_target_lists_squares, prom_target_lists, n_prom_target_lists, piece + color);
 		}
 	}
 	// Castling and En Passant Moves
+	uint16_t n_moves = move_i - move_list;
 	for (int i = 0; i < 6; i++) {
 		move_list[n_moves] = special_moves[i];
 		n_moves += special_moves[i].code != Move::NULL_MOVE;
@@ -286,6 +344,166 @@ void MoveGenerator::GetMoves(const BoardComposite * board, MoveList * output) {
 	
 	output->n_moves = n_moves;
 	output->valid = true;
+	output->truncated = truncated;
+	output->legal = legal;
+	return n_moves;
+}
+
+void MoveGenerator::GetLegalMoves(const BoardComposite * boards, size_t n_boards, MoveBatch * output, unsigned n_threads) {
+	GenerateBatch(boards, n_boards, output, n_threads);
+}
+
+void MoveGenerator::GetLegalMoves(const BoardState * states, size_t n_states, MoveBatch * output, unsigned n_threads) {
+	GenerateBatch(states, n_states, output, n_threads);
+}
+
+template <typename Position>
+void MoveGenerator::GenerateBatch(const Position * positions, size_t n_positions, MoveBatch * output, unsigned n_threads) {
+	// Give each thread at least a few blocks, so small batches are not slowed
+	// down by starting threads
+	if (n_threads == 0) n_threads = std::thread::hardware_concurrency();
+	n_threads = std::min<size_t>(n_threads, n_positions / (4 * BATCH_BLOCK));
+	if (n_threads == 0) n_threads = 1;
+	
+	// The length of each position goes in the offset after it, so that a
+	// running sum turns the lengths into offsets
+	output->offsets.resize(n_positions + 1);
+	output->offsets[0] = 0;
+	uint32_t * lengths = output->offsets.data() + 1;
+	
+	if (n_threads == 1) {
+		output->moves.clear();
+		output->truncated = GenerateBatch(positions, 0, n_positions, &output->moves, lengths);
+	}
+	else {
+		// Each thread fills its own array, and the arrays are joined in order
+		std::vector<std::vector<Move>> thread_moves(n_threads);
+		std::vector<char> thread_truncated(n_threads);
+		std::vector<std::thread> threads;
+		for (unsigned i = 0; i < n_threads; i++) {
+			size_t begin = n_positions * i / n_threads;
+			size_t end = n_positions * (i + 1) / n_threads;
+			threads.push_back(std::thread([=, &thread_moves, &thread_truncated]() {
+				thread_truncated[i] = GenerateBatch(positions, begin, end, &thread_moves[i], lengths);
+			}));
+		}
+		size_t n_moves = 0;
+		output->truncated = false;
+		for (unsigned i = 0; i < n_threads; i++) {
+			threads[i].join();
+			n_moves += thread_moves[i].size();
+			output->truncated |= (bool)thread_truncated[i];
+		}
+		output->moves.resize(n_moves);
+		std::vector<Move>::iterator move_i = output->moves.begin();
+		for (unsigned i = 0; i < n_threads; i++) {
+			move_i = std::copy(thread_moves[i].begin(), thread_moves[i].end(), move_i);
+		}
+	}
+	
+	for (size_t i = 0; i < n_positions; i++) {
+		output->offsets[i + 1] += output->offsets[i];
+	}
+}
+
+bool MoveGenerator::GenerateBatch(const BoardComposite * boards, size_t begin, size_t end, std::vector<Move> * moves, uint32_t * lengths) {
+	MoveList list;
+	bool truncated = false;
+	for (size_t i = begin; i < end; i++) {
+		// Start loading the position a block ahead; most of a Board Composite
+		// is the move cache, so only the state and bitboards before it are needed
+		if (i + BATCH_BLOCK < end) {
+			const char * next = (const char *)&boards[i + BATCH_BLOCK];
+			const char * next_end = (const char *)&boards[i + BATCH_BLOCK].roster;
+			for (; next < next_end; next += 64) __builtin_prefetch(next);
+		}
+		GenerateMoves(&boards[i], &list, true, ALL_MOVES, ~(Bitboard_t)0);
+		moves->insert(moves->end(), list.Begin(), list.End());
+		lengths[i] = list.Length();
+		truncated |= list.IsTruncated();
+	}
+	return truncated;
+}
+
+bool MoveGenerator::GenerateBatch(const BoardState * states, size_t begin, size_t end, std::vector<Move> * moves, uint32_t * lengths) {
+	MoveList list;
+	bool truncated = false;
+	BoardComposite block[BATCH_BLOCK];
+	for (size_t i = begin; i < end; i += BATCH_BLOCK) {
+		// Build the whole block before generating from it; the builds do not
+		// depend on each other, so their loads can overlap
+		size_t n_block = std::min<size_t>(BATCH_BLOCK, end - i);
+		for (size_t j = 0; j < n_block; j++) {
+			block[j].Init(states[i + j]);
+		}
+		for (size_t j = 0; j < n_block; j++) {
+			GenerateMoves(&block[j], &list, true, ALL_MOVES, ~(Bitboard_t)0);
+			moves->insert(moves->end(), list.Begin(), list.End());
+			lengths[i + j] = list.Length();
+			truncated |= list.IsTruncated();
+		}
+	}
+	return truncated;
+}
+
+int MoveGenerator::CountLegalMoves(const BoardComposite * board) {
+	return GenerateMoves(board, NULL, true, ALL_MOVES, ~(Bitboard_t)0);
+}
+
+bool MoveGenerator::HasAnyLegalMove(const BoardComposite * board) {
+	if (board->state.white_to_move) return HasAnyLegalMove<WHITE>(board);
+	else return HasAnyLegalMove<BLACK>(board);
+}
+
+template <bool IS_WHITE>
+bool MoveGenerator::HasAnyLegalMove(const BoardComposite * board) {
+	uint8_t king = IS_WHITE ? board->wking_pos : board->bking_pos;
+	if (king >= 64) return CountLegalMoves(board) > 0;
+	
+	Bitboard_t friendly = IS_WHITE ? board->white : board->black;
+	Bitboard_t enemy = IS_WHITE ? board->black : board->white;
+	Bitboard_t all = friendly | enemy;
+	const uint8_t color = IS_WHITE ? 0 : 8;
+	
+	// Try the king first; it can usually move, and it is the only piece that
+	// can move out of a double check. Castling is never needed, because the
+	// king could also step to the square the rook lands on.
+	Bitboard_t targets = k_masks[king] & ~friendly;
+	while (targets) {
+		uint8_t target = PopLSB(targets);
+		if (!GetAttackers<!IS_WHITE>(board, target, all ^ ((Bitboard_t)1 << king))) return true;
+	}
+	
+	Bitboard_t checkers = GetAttackers<!IS_WHITE>(board, king, all);
+	Bitboard_t evasions = GetEvasionSquares(king, checkers);
+	if (!evasions) return false;
+	Bitboard_t pinned = GetPinned<IS_WHITE>(board, king);
+	
+	// Stop at the first piece with a legal target
+	Bitboard_t pieces = friendly & ~board->pieces[WHITE_KING + color];
+	while (pieces) {
+		uint8_t square = PopLSB(pieces);
+		switch (board->state.squares[square] - color) {
+			case WHITE_PAWN: targets = GetPTargets<IS_WHITE>(all, enemy, square); break;
+			case WHITE_KNIGHT: targets = n_masks[square]; break;
+			case WHITE_BISHOP: targets = GetBAttacks(all, square); break;
+			case WHITE_ROOK: targets = GetRAttacks(all, square); break;
+			case WHITE_QUEEN: targets = GetQAttacks(all, square); break;
+			default: targets = 0;
+		}
+		targets &= ~friendly & evasions;
+		if (pinned & ((Bitboard_t)1 << square)) targets &= line_masks[king][square];
+		if (targets) return true;
+	}
+	
+	// En passant can be the only legal move
+	uint8_t ep_target = board->state.ep_target;
+	if (ep_target) {
+		uint8_t ep_end = IS_WHITE ? ep_target + 8 : ep_target - 8;
+		if (ep_target % 8 != 7 && IsLegal<IS_WHITE>(board, Move(ep_target + 1, ep_end, Move::EN_PASSANT))) return true;
+		if (ep_target % 8 != 0 && IsLegal<IS_WHITE>(board, Move(ep_target - 1, ep_end, Move::EN_PASSANT))) return true;
+	}
+	return false;
 }
 
 MoveList MoveGenerator::GetUnmoves(const BoardComposite * board) {
@@ -295,251 +513,759 @@ MoveList MoveGenerator::GetUnmoves(const BoardComposite * board) {
 }
 
 void MoveGenerator::GetUnmoves(const BoardComposite * board, MoveList * output) {
-	Bitboard_t friendly, enemy;
-	uint8_t piece;
+	Bitboard_t all = board->white | board->black;
 	
-	static int coord_lists_squares[256];
-	static CoordList coord_lists[256];
-	int n_coord_lists = 0;
+	// If black to move, looking for white moves that would have gotten us there
+	// If white to move, looking for black moves that would have gotten us there
+	uint8_t color = board->state.white_to_move ? 8 : 0;
 	
-	int n_prom_coord_lists = 0;
+	uint8_t target_lists_squares[64];
+	Bitboard_t target_lists[64];
+	int n_target_lists = 0;
 	
-	// If black to move, looking for white moves that would have gotten us there
-	if (!board->state.white_to_move)
-	{
-		friendly = board->white | board->black;
-		enemy = 0;
-		
-		for (int square = 0; square < 64; square++) {
-			
-			piece = board->state.squares[square];
-			
-			if (piece == EMPTY || piece > 8
-				|| piece == WHITE_PAWN || piece == BLACK_PAWN) continue;
+	// Pieces can only have come from empty squares; pawns are skipped
+	Bitboard_t pieces;
+	uint8_t square;
+	
+	pieces = board->pieces[WHITE_KNIGHT + color];
+	while (pieces) {
+		square = PopLSB(pieces);
+		target_lists[n_target_lists] = n_masks[square] & ~all;
+		target_lists_squares[n_target_lists++] = square;
+	}
+	pieces = board->pieces[WHITE_BISHOP + color];
+	while (pieces) {
+		square = PopLSB(pieces);
+		target_lists[n_target_lists] = GetBAttacks(all, square) & ~all;
+		target_lists_squares[n_target_lists++] = square;
+	}
+	pieces = board->pieces[WHITE_ROOK + color];
+	while (pieces) {
+		square = PopLSB(pieces);
+		target_lists[n_target_lists] = GetRAttacks(all, square) & ~all;
+		target_lists_squares[n_target_lists++] = square;
+	}
+	pieces = board->pieces[WHITE_QUEEN + color];
+	while (pieces) {
+		square = PopLSB(pieces);
+		target_lists[n_target_lists] = GetQAttacks(all, square) & ~all;
+		target_lists_squares[n_target_lists++] = square;
+	}
+	pieces = board->pieces[WHITE_KING + color];
+	while (pieces) {
+		square = PopLSB(pieces);
+		target_lists[n_target_lists] = k_masks[square] & ~all;
+		target_lists_squares[n_target_lists++] = square;
+	}
+	
+	// Drop moves that do not fit in the list
+	bool truncated = false;
+	LimitTargets(target_lists, n_target_lists, MoveList::MAX_MOVES, 1, &truncated);
+	
+	// Get variables for assigning output
+	Move * move_list = output->moves;
+	Move * move_i = move_list;
+	
+	// Normal Moves
+	move_i = EmitMoves(move_i, target_lists_squares, target_lists, n_target_lists, Move::NORMAL_MOVE);
+	
+	output->n_moves = move_i - move_list;
+	output->valid = true;
+	output->truncated = truncated;
+	output->legal = false;
+}
 
-			else if (piece == WHITE_KNIGHT) {
-				coord_lists[n_coord_lists] = GetNMoves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-			}
-			else if (piece == WHITE_BISHOP) {
-				coord_lists[n_coord_lists] = GetD1Moves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-				coord_lists[n_coord_lists] = GetD2Moves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-			}
-			else if (piece == WHITE_ROOK) {
-				coord_lists[n_coord_lists] = GetHMoves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-				coord_lists[n_coord_lists] = GetVMoves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-			}
-			else if (piece == WHITE_QUEEN) {
-				coord_lists[n_coord_lists] = GetD1Moves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-				coord_lists[n_coord_lists] = GetD2Moves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-				coord_lists[n_coord_lists] = GetHMoves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-				coord_lists[n_coord_lists] = GetVMoves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-			}
-			else if (piece == WHITE_KING) {
-				coord_lists[n_coord_lists] = GetKMoves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-			}
+void MoveGenerator::GetUnmoves(const BoardComposite * board, std::vector<Unmove> * output, Material_t max_material) {
+	// The color that made the last move is the one not to move
+	if (board->state.white_to_move) GenerateUnmoves<BLACK>(board, output, max_material);
+	else GenerateUnmoves<WHITE>(board, output, max_material);
+	AddRightsUnmoves(board->state, output);
+}
+
+template <bool BY_WHITE>
+void MoveGenerator::GenerateUnmoves(const BoardComposite * board, std::vector<Unmove> * output, Material_t max_material) {
+	output->clear();
+	
+	const BoardState & state = board->state;
+	Bitboard_t all = board->white | board->black;
+	Bitboard_t empty = ~all;
+	Material_t material = board->GetMaterial();
+	
+	// Piece codes of the color that moved, and of the color that could have
+	// lost a piece, are offset from the white codes
+	const uint8_t color = BY_WHITE ? 0 : 8;
+	const uint8_t enemy_color = BY_WHITE ? 8 : 0;
+	
+	// Ranks seen from the color that moved; pawns stand between its second
+	// and seventh ranks, and promote on its eighth
+	const Bitboard_t RANK_2 = BY_WHITE ? 0x000000000000ff00 : 0x00ff000000000000;
+	const Bitboard_t RANK_6 = BY_WHITE ? 0x0000ff0000000000 : 0x0000000000ff0000;
+	const Bitboard_t RANK_8 = BY_WHITE ? 0xff00000000000000 : 0x00000000000000ff;
+	const int forward = BY_WHITE ? 8 : -8;
+	
+	// After a double pawn push, nothing else can have been the last move
+	if (state.ep_target) {
+		uint8_t square = state.ep_target;
+		uint8_t start = square - 2 * forward;
+		if (state.squares[square] == WHITE_PAWN + color && state.squares[square - forward] == EMPTY &&
+				state.squares[start] == EMPTY) {
+			output->push_back(Unmove { Move(start, square, Move::NORMAL_MOVE), EMPTY, material });
 		}
+		return;
 	}
-	// If white to move, looking for black moves that would have gotten us there
-	else
-	{
-		friendly = board->black | board->white;
-		enemy = 0;
-		
-		for (int square = 0; square < 64; square++) {
-			
-			piece = board->state.squares[square];
+	
+	// Pieces of the color to move that may be put back, pawns first; a side
+	// never has more than sixteen pieces or eight pawns
+	uint8_t uncaptures[5];
+	int n_uncaptures = 0;
+	int n_enemy = CountBits(BY_WHITE ? board->black : board->white);
+	for (uint8_t piece = WHITE_PAWN + enemy_color; piece <= WHITE_QUEEN + enemy_color; piece++) {
+		if (n_enemy >= 16 || CountMaterial(material, piece) >= CountMaterial(max_material, piece)) continue;
+		if (piece == WHITE_PAWN + enemy_color && CountMaterial(material, piece) >= 8) continue;
+		uncaptures[n_uncaptures++] = piece;
+	}
+	bool pawn_uncapture = n_uncaptures && uncaptures[0] == WHITE_PAWN + enemy_color;
+	
+	// A king or rook whose castling right is still held has never moved
+	bool can_OO = BY_WHITE ? state.white_OO : state.black_OO;
+	bool can_OOO = BY_WHITE ? state.white_OOO : state.black_OOO;
+	Bitboard_t unmoved = 0;
+	if (can_OO || can_OOO) unmoved |= board->pieces[WHITE_KING + color];
+	if (can_OO) unmoved |= (Bitboard_t)1 << (BY_WHITE ? 7 : 63);
+	if (can_OOO) unmoved |= (Bitboard_t)1 << (BY_WHITE ? 0 : 56);
+	
+	// Pieces came back from empty squares they attack; a captured pawn cannot
+	// have stood on the first or last rank
+	for (uint8_t piece = WHITE_KNIGHT; piece <= WHITE_KING; piece++) {
+		Bitboard_t pieces = board->pieces[piece + color] & ~unmoved;
+		while (pieces) {
+			uint8_t square = PopLSB(pieces);
+			Bitboard_t from;
+			if (piece == WHITE_KNIGHT) from = n_masks[square];
+			else if (piece == WHITE_BISHOP) from = GetBAttacks(all, square);
+			else if (piece == WHITE_ROOK) from = GetRAttacks(all, square);
+			else if (piece == WHITE_QUEEN) from = GetQAttacks(all, square);
+			else from = k_masks[square];
 			
-			if (piece == EMPTY || piece < 8
-				|| piece == WHITE_PAWN || piece == BLACK_PAWN) continue;
+			bool back_rank = square < 8 || square >= 56;
+			int skip = back_rank && pawn_uncapture;
+			AddUnmoves(output, square, from & empty, Move::NORMAL_MOVE, material, true,
+				uncaptures + skip, n_uncaptures - skip);
 			
-			else if (piece == BLACK_KNIGHT) {
-				coord_lists[n_coord_lists] = GetNMoves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-			}
-			else if (piece == BLACK_BISHOP) {
-				coord_lists[n_coord_lists] = GetD1Moves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-				coord_lists[n_coord_lists] = GetD2Moves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-			}
-			else if (piece == BLACK_ROOK) {
-				coord_lists[n_coord_lists] = GetHMoves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-				coord_lists[n_coord_lists] = GetVMoves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-			}
-			else if (piece == BLACK_QUEEN) {
-				coord_lists[n_coord_lists] = GetD1Moves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-				coord_lists[n_coord_lists] = GetD2Moves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-				coord_lists[n_coord_lists] = GetHMoves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-				coord_lists[n_coord_lists] = GetVMoves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
-			}
-			else if (piece == BLACK_KING) {
-				coord_lists[n_coord_lists] = GetKMoves(friendly, enemy, square);
-				coord_lists_squares[n_coord_lists++] = square;
+			// Unpromotions, straight back or with an uncapture
+			if (piece != WHITE_KING && ((RANK_8 >> square) & 1) && CountMaterial(material, WHITE_PAWN + color) < 8 &&
+					CountMaterial(material, WHITE_PAWN + color) < CountMaterial(max_material, WHITE_PAWN + color)) {
+				Material_t unpromoted = material + MaterialOf(WHITE_PAWN + color) - MaterialOf(piece + color);
+				Bitboard_t pawn_from = BY_WHITE ? bp_masks[square] : wp_masks[square];
+				AddUnmoves(output, square, ((Bitboard_t)1 << (square - forward)) & empty, piece + color,
+					unpromoted, true, NULL, 0);
+				AddUnmoves(output, square, pawn_from & empty, piece + color,
+					unpromoted, false, uncaptures + skip, n_uncaptures - skip);
 			}
 		}
 	}
 	
-	// Allocate Memory
-	uint16_t n_alloc = (n_coord_lists + n_prom_coord_lists) * 8 + 6;
-	if (output->moves) {
-		// If there is not enough memory, free and allocate later
-		if (output->n_alloc < n_alloc) {
-			delete[] output->moves;
-			output->moves = NULL;
-			output->n_moves = 0;
-			output->n_alloc = 0;
-		}
+	// Castling puts the king and rook back on their home squares, and the
+	// earlier position held the castling right that it used
+	const uint8_t rank = BY_WHITE ? 0 : 56;
+	const uint8_t king_piece = WHITE_KING + color;
+	const uint8_t rook_piece = WHITE_ROOK + color;
+	if (state.squares[rank + 6] == king_piece && state.squares[rank + 5] == rook_piece &&
+			state.squares[rank + 4] == EMPTY && state.squares[rank + 7] == EMPTY) {
+		output->push_back(Unmove { Move(rank + 4, rank + 6, BY_WHITE ? Move::WHITE_OO : Move::BLACK_OO),
+			EMPTY, material, BY_WHITE ? Unmove::WHITE_OO : Unmove::BLACK_OO, 0 });
 	}
-	// Allocate fresh/new memory
-	if (!output->moves) {
-		output->moves = new Move[n_alloc];
-		output->n_moves = 0;
-		output->n_alloc = n_alloc;
+	if (state.squares[rank + 2] == king_piece && state.squares[rank + 3] == rook_piece &&
+			state.squares[rank + 4] == EMPTY && state.squares[rank + 0] == EMPTY && state.squares[rank + 1] == EMPTY) {
+		output->push_back(Unmove { Move(rank + 4, rank + 2, BY_WHITE ? Move::WHITE_OOO : Move::BLACK_OOO),
+			EMPTY, material, BY_WHITE ? Unmove::WHITE_OOO : Unmove::BLACK_OOO, 0 });
 	}
 	
-	// Get variables for assigning output
-	Move * move_list = output->moves;
-	uint16_t n_moves = 0;
-	
-	// Normal Moves
-	for (int i = 0; i < n_coord_lists; i++) {
-		//std::cout << (int)coord_lists_squares[i] << ": " << coord_lists[i] << std::endl;
+	// Pawns retreat one square, or diagonally with an uncapture; pawns that
+	// stand on their second rank have not moved
+	Bitboard_t pawns = board->pieces[WHITE_PAWN + color] & ~RANK_2;
+	while (pawns) {
+		uint8_t square = PopLSB(pawns);
+		Bitboard_t pawn_from = BY_WHITE ? bp_masks[square] : wp_masks[square];
+		AddUnmoves(output, square, ((Bitboard_t)1 << (square - forward)) & empty, Move::NORMAL_MOVE,
+			material, true, NULL, 0);
+		AddUnmoves(output, square, pawn_from & empty, Move::NORMAL_MOVE,
+			material, false, uncaptures, n_uncaptures);
 		
-		for (int j = 0; j < 8; j++) {
-			move_list[n_moves].start = coord_lists_squares[i];
-			move_list[n_moves].end = coord_lists[i].coords[j];
-			move_list[n_moves].code = Move::NORMAL_MOVE;
-			
-			n_moves += coord_lists[i].coords[j] < 64;
+		// En passant: the captured pawn goes back behind the capturing pawn,
+		// and the squares it crossed in its double push must be empty
+		if (pawn_uncapture && ((RANK_6 >> square) & 1) &&
+				state.squares[square - forward] == EMPTY && state.squares[square + forward] == EMPTY) {
+			uint8_t pawn = WHITE_PAWN + enemy_color;
+			AddUnmoves(output, square, pawn_from & empty, Move::EN_PASSANT, material, false, &pawn, 1);
 		}
 	}
+}
+
+template void MoveGenerator::GenerateUnmoves<WHITE>(const BoardComposite * board, std::vector<Unmove> * output, Material_t max_material);
+template void MoveGenerator::GenerateUnmoves<BLACK>(const BoardComposite * board, std::vector<Unmove> * output, Material_t max_material);
+
+void MoveGenerator::GetLegalUnmoves(const BoardComposite * board, std::vector<Unmove> * unmoves,
+		std::vector<BoardState> * earlier, Material_t max_material) {
+	GetUnmoves(board, unmoves, max_material);
 	
-	output->n_moves = n_moves;
-	output->valid = true;
+	// Keep the legal unmoves in order
+	bool by_white = !board->state.white_to_move;
+	std::vector<Unmove>::iterator unmove_i = unmoves->begin();
+	std::vector<Unmove>::iterator legal_end = unmoves->begin();
+	for (; unmove_i != unmoves->end(); unmove_i++) {
+		if (by_white ? IsLegalUnmove<WHITE>(board, *unmove_i) : IsLegalUnmove<BLACK>(board, *unmove_i)) {
+			*legal_end++ = *unmove_i;
+		}
+	}
+	unmoves->erase(legal_end, unmoves->end());
+	
+	if (earlier) {
+		earlier->resize(unmoves->size());
+		for (size_t i = 0; i < unmoves->size(); i++) {
+			MakeUnmove(board->state, (*unmoves)[i], &(*earlier)[i]);
+		}
+	}
 }
 
-bool MoveGenerator::InCheck(const BoardComposite * board, bool is_white) {
-	Bitboard_t enemy_pieces = is_white ? board->black : board->white;
-	Bitboard_t enemy_pawns = is_white ? board->bpawns : board->wpawns;
-	Bitboard_t enemy_pieces_no_pawns = enemy_pieces & ~enemy_pawns;
-	Bitboard_t friendly_pieces = is_white ? board->white : board->black;
+template <bool BY_WHITE>
+bool MoveGenerator::IsLegalUnmove(const BoardComposite * board, const Unmove & unmove) {
+	uint8_t king = BY_WHITE ? board->bking_pos : board->wking_pos;
+	if (king >= 64) return true;
 	
-	int king_square = is_white ? board->wking_pos : board->bking_pos;
+	if (unmove.move.code >= Move::WHITE_OO && unmove.move.code <= Move::BLACK_OOO) {
+		// The king and rook are back on their home squares
+		bool is_short = unmove.move.end > unmove.move.start;
+		uint8_t rook_start = is_short ? unmove.move.start + 3 : unmove.move.start - 4;
+		uint8_t rook_end = is_short ? unmove.move.start + 1 : unmove.move.start - 1;
+		Bitboard_t moved = ((Bitboard_t)1 << unmove.move.end) | ((Bitboard_t)1 << rook_end);
+		Bitboard_t occupancy = ((board->white | board->black) & ~moved) |
+			((Bitboard_t)1 << unmove.move.start) | ((Bitboard_t)1 << rook_start);
+		if (GetAttackers<BY_WHITE>(board, king, occupancy) & ~moved) return false;
+		if (((GetRAttacks(occupancy, rook_start) | k_masks[unmove.move.start]) >> king) & 1) return false;
+		
+		// The king cannot have castled out of or through check
+		return !GetAttackers<!BY_WHITE>(board, unmove.move.start, occupancy) &&
+			!GetAttackers<!BY_WHITE>(board, rook_end, occupancy);
+	}
 	
-	// For each piece, checks if a check is possible using bitboards
-	// If not, then skips; if so, then does a more in-depth check
+	// Occupancy of the earlier position: the piece is back on its start
+	// square, and the captured piece is back where it stood
+	uint8_t start = unmove.move.start;
+	uint8_t end = unmove.move.end;
+	Bitboard_t start_mask = (Bitboard_t)1 << start;
+	Bitboard_t end_mask = (Bitboard_t)1 << end;
+	Bitboard_t occupancy = ((board->white | board->black) & ~end_mask) | start_mask;
+	if (unmove.uncapture) {
+		if (unmove.move.code == Move::EN_PASSANT) occupancy |= (Bitboard_t)1 << (BY_WHITE ? end - 8 : end + 8);
+		else occupancy |= end_mask;
+	}
 	
-	// Knight checks
-	if (n_masks[king_square] & enemy_pieces_no_pawns) {
-		CoordList knight_checks = GetNMoves(friendly_pieces, enemy_pieces, king_square);
-		for (int i = 0; i < 8; i++) {
-			if (knight_checks.coords[i] < 64 && 
-				(board->state.squares[knight_checks.coords[i]] & 7) == WHITE_KNIGHT)
-			{
-				return true;
-			}
+	// Attackers other than the moved piece are where they are now
+	if (GetAttackers<BY_WHITE>(board, king, occupancy) & ~end_mask) return false;
+	
+	// The moved piece attacks from its start square, as a pawn if it promoted
+	uint8_t piece = board->state.squares[end] & 7;
+	if (unmove.move.code != Move::NORMAL_MOVE && unmove.move.code != Move::EN_PASSANT) piece = WHITE_PAWN;
+	Bitboard_t attacks;
+	if (piece == WHITE_PAWN) attacks = BY_WHITE ? wp_masks[start] : bp_masks[start];
+	else if (piece == WHITE_KNIGHT) attacks = n_masks[start];
+	else if (piece == WHITE_BISHOP) attacks = GetBAttacks(occupancy, start);
+	else if (piece == WHITE_ROOK) attacks = GetRAttacks(occupancy, start);
+	else if (piece == WHITE_QUEEN) attacks = GetQAttacks(occupancy, start);
+	else attacks = k_masks[start];
+	return !((attacks >> king) & 1);
+}
+
+template bool MoveGenerator::IsLegalUnmove<WHITE>(const BoardComposite * board, const Unmove & unmove);
+template bool MoveGenerator::IsLegalUnmove<BLACK>(const BoardComposite * board, const Unmove & unmove);
+
+void MoveGenerator::AddUnmoves(std::vector<Unmove> * output, uint8_t square, Bitboard_t from, uint8_t code,
+		Material_t material, bool quiet, const uint8_t * uncaptures, int n_uncaptures) {
+	while (from) {
+		uint8_t start = PopLSB(from);
+		if (quiet) {
+			output->push_back(Unmove { Move(start, square, code), EMPTY, material });
+		}
+		for (int i = 0; i < n_uncaptures; i++) {
+			output->push_back(Unmove { Move(start, square, code), uncaptures[i], material + MaterialOf(uncaptures[i]) });
 		}
 	}
+}
+
+void MoveGenerator::AddRightsUnmoves(const BoardState & state, std::vector<Unmove> * output) {
+	// Home squares of the king and rook of each castling right, in the order
+	// of the bits of Unmove::castling
+	const uint8_t kings[4] = { 4, 4, 60, 60 };
+	const uint8_t rooks[4] = { 7, 0, 63, 56 };
 	
-	// King checks
-	if (k_masks[king_square] & enemy_pieces_no_pawns) {
-		CoordList king_checks = GetKMoves(friendly_pieces, enemy_pieces, king_square);
-		for (int i = 0; i < 8; i++) {
-			if (king_checks.coords[i] < 64 && 
-				(board->state.squares[king_checks.coords[i]] & 7) == WHITE_KING)
-			{
-				return true;
+	// The color to move may have made a double push just before the earlier
+	// position, from its second rank to its fourth
+	const uint8_t pawn = state.white_to_move ? WHITE_PAWN : BLACK_PAWN;
+	const int forward = state.white_to_move ? 8 : -8;
+	const uint8_t fourth_rank = state.white_to_move ? 24 : 32;
+	
+	size_t n_unmoves = output->size();
+	for (size_t i = 0; i < n_unmoves; i++) {
+		Unmove unmove = (*output)[i];
+		BoardState earlier;
+		MakeUnmove(state, unmove, &earlier);
+		
+		// A right lost by the move needs the king and rook at home before it,
+		// and one of them gone after it
+		bool held[4] = { earlier.white_OO, earlier.white_OOO, earlier.black_OO, earlier.black_OOO };
+		uint8_t rights = 0;
+		for (int j = 0; j < 4; j++) {
+			uint8_t king = (kings[j] & 56) ? BLACK_KING : WHITE_KING;
+			uint8_t rook = (kings[j] & 56) ? BLACK_ROOK : WHITE_ROOK;
+			if (!held[j] && earlier.squares[kings[j]] == king && earlier.squares[rooks[j]] == rook &&
+					(state.squares[kings[j]] != king || state.squares[rooks[j]] != rook)) {
+				rights |= 1 << j;
 			}
 		}
-	}
-
-	// Rook checks
-	if (h_masks[king_square] & enemy_pieces_no_pawns) {
-		CoordList h_checks = GetHMoves(friendly_pieces, enemy_pieces, king_square);
-		for (int i = 0; i < 8; i++) {
-			if (h_checks.coords[i] < 64) {
-				uint8_t piece = board->state.squares[h_checks.coords[i]] & 7;
-				if (piece == WHITE_ROOK || piece == WHITE_QUEEN) return true;
+		
+		uint8_t ep_targets[9] = { 0 };
+		int n_ep_targets = 1;
+		if (unmove.move.code != Move::EN_PASSANT) {
+			for (uint8_t square = fourth_rank; square < fourth_rank + 8; square++) {
+				if (earlier.squares[square] == pawn && earlier.squares[square - forward] == EMPTY &&
+						earlier.squares[square - 2 * forward] == EMPTY) {
+					ep_targets[n_ep_targets++] = square;
+				}
 			}
 		}
-	}
-	if (v_masks[king_square] & enemy_pieces_no_pawns) {
-		CoordList v_checks = GetVMoves(friendly_pieces, enemy_pieces, king_square);
-		for (int i = 0; i < 8; i++) {
-			if (v_checks.coords[i] < 64) {
-				uint8_t piece = board->state.squares[v_checks.coords[i]] & 7;
-				if (piece == WHITE_ROOK || piece == WHITE_QUEEN) return true;
+		
+		// Every subset of the rights, with each en passant target or none,
+		// except the unmove itself
+		for (uint8_t subset = rights; ; subset = (subset - 1) & rights) {
+			for (int j = 0; j < n_ep_targets; j++) {
+				if (!subset && !ep_targets[j]) continue;
+				Unmove variant = unmove;
+				variant.castling |= subset;
+				variant.ep_target = ep_targets[j];
+				output->push_back(variant);
 			}
+			if (!subset) break;
 		}
 	}
+}
+
+void MoveGenerator::MakeUnmove(const BoardState & state, Unmove unmove, BoardState * output) {
+	*output = state;
+	uint8_t start = unmove.move.start;
+	uint8_t end = unmove.move.end;
+	uint8_t piece = state.squares[end];
+	bool castling = unmove.move.code >= Move::WHITE_OO && unmove.move.code <= Move::BLACK_OOO;
 	
-	// Bishop checks
-	if (d1_masks[king_square] & enemy_pieces_no_pawns) {
-		CoordList d1_checks = GetD1Moves(friendly_pieces, enemy_pieces, king_square);
-		for (int i = 0; i < 8; i++) {
-			if (d1_checks.coords[i] < 64) {
-				uint8_t piece = board->state.squares[d1_checks.coords[i]] & 7;
-				if (piece == WHITE_BISHOP || piece == WHITE_QUEEN) return true;
-			}
-		}
+	// Promoted pieces go back to being pawns
+	if (unmove.move.code != Move::NORMAL_MOVE && unmove.move.code != Move::EN_PASSANT && !castling) {
+		piece = (piece & 8) | WHITE_PAWN;
 	}
-	if (d2_masks[king_square] & enemy_pieces_no_pawns) {
-		CoordList d2_checks = GetD2Moves(friendly_pieces, enemy_pieces, king_square);
-		//std::cout << d2_checks << std::endl;
-		for (int i = 0; i < 8; i++) {
-			if (d2_checks.coords[i] < 64) {
-				uint8_t piece = board->state.squares[d2_checks.coords[i]] & 7;
-				if (piece == WHITE_BISHOP || piece == WHITE_QUEEN) return true;
-			}
+	output->squares[start] = piece;
+	output->squares[end] = EMPTY;
+	output->ep_target = unmove.ep_target;
+	
+	// The rook goes back to its corner after castling
+	if (castling) {
+		bool is_short = end > start;
+		output->squares[is_short ? start + 3 : start - 4] = output->squares[is_short ? start + 1 : start - 1];
+		output->squares[is_short ? start + 1 : start - 1] = EMPTY;
+	}
+	output->white_OO = state.white_OO || (unmove.castling & Unmove::WHITE_OO);
+	output->white_OOO = state.white_OOO || (unmove.castling & Unmove::WHITE_OOO);
+	output->black_OO = state.black_OO || (unmove.castling & Unmove::BLACK_OO);
+	output->black_OOO = state.black_OOO || (unmove.castling & Unmove::BLACK_OOO);
+	
+	// The captured piece goes back where it stood; a pawn captured en passant
+	// had just made the double push that allowed the capture
+	if (unmove.move.code == Move::EN_PASSANT) {
+		uint8_t captured = (piece & 8) ? end + 8 : end - 8;
+		output->squares[captured] = unmove.uncapture;
+		output->ep_target = captured;
+	}
+	else {
+		output->squares[end] = unmove.uncapture;
+	}
+	
+	// The count was one less before a quiet move; before a capture, pawn move
+	// or castling it is unknown, so it starts again from zero, as it does
+	// after the double push that set an en passant target
+	if ((piece & 7) == WHITE_PAWN || unmove.uncapture || castling || unmove.ep_target) {
+		output->n_ply_without_progress = 0;
+	}
+	else if (output->n_ply_without_progress) output->n_ply_without_progress--;
+	
+	output->white_to_move = !state.white_to_move;
+}
+
+int MoveGenerator::LimitTargets(Bitboard_t * target_lists, int n_target_lists, int capacity, int moves_per_target, bool * truncated) {
+	int n_moves = 0;
+	for (int i = 0; i < n_target_lists; i++) {
+		while (n_moves + CountBits(target_lists[i]) * moves_per_target > capacity) {
+			target_lists[i] &= target_lists[i] - 1;
+			*truncated = true;
 		}
+		n_moves += CountBits(target_lists[i]) * moves_per_target;
 	}
+	return n_moves;
+}
+
+Bitboard_t MoveGenerator::GetAttackers(const BoardComposite * board, uint8_t square, Bitboard_t occupancy, bool by_white) {
+	return by_white ? GetAttackers<WHITE>(board, square, occupancy) : GetAttackers<BLACK>(board, square, occupancy);
+}
+
+template <bool BY_WHITE>
+Bitboard_t MoveGenerator::GetAttackers(const BoardComposite * board, uint8_t square, Bitboard_t occupancy) {
+	const uint8_t color = BY_WHITE ? 0 : 8;
+	Bitboard_t queens = board->pieces[WHITE_QUEEN + color];
+	return
+		(n_masks[square] & board->pieces[WHITE_KNIGHT + color]) |
+		(k_masks[square] & board->pieces[WHITE_KING + color]) |
+		// A pawn attacks this square if a pawn of the other color here would attack the pawn
+		((BY_WHITE ? bp_masks[square] : wp_masks[square]) & board->pieces[WHITE_PAWN + color]) |
+		(GetBAttacks(occupancy, square) & (board->pieces[WHITE_BISHOP + color] | queens)) |
+		(GetRAttacks(occupancy, square) & (board->pieces[WHITE_ROOK + color] | queens));
+}
+
+template <bool SNIPER_WHITE>
+Bitboard_t MoveGenerator::GetBlockers(const BoardComposite * board, uint8_t king) {
+	const uint8_t sniper_color = SNIPER_WHITE ? 0 : 8;
+	Bitboard_t all = board->white | board->black;
+	Bitboard_t queens = board->pieces[WHITE_QUEEN + sniper_color];
+	
+	// Sliders that would attack the king on an empty board
+	Bitboard_t snipers =
+		(r_masks[king] & (board->pieces[WHITE_ROOK + sniper_color] | queens)) |
+		(b_masks[king] & (board->pieces[WHITE_BISHOP + sniper_color] | queens));
 	
-	// Pawn checks
-	if (king_square % 8 != 0) {
-		if ((is_white && king_square < 48) || (!is_white && king_square >= 16)) {
-			uint8_t target_square = is_white ? king_square + 7 : king_square - 9;
-			if (board->state.squares[target_square] == (is_white ? BLACK_PAWN : WHITE_PAWN)) return true;
+	// A piece blocks if it is the only piece between the king and a sniper
+	Bitboard_t blockers = 0;
+	while (snipers) {
+		Bitboard_t between = between_masks[king][PopLSB(snipers)] & all;
+		if (between && !(between & (between - 1))) {
+			blockers |= between;
 		}
 	}
-	if (king_square % 8 != 7) {
-		if ((is_white && king_square < 48) || (!is_white && king_square >= 16)) {
-			uint8_t target_square = is_white ? king_square + 9 : king_square - 7;
-			if (board->state.squares[target_square] == (is_white ? BLACK_PAWN : WHITE_PAWN)) return true;
+	return blockers;
+}
+
+template <bool IS_WHITE>
+Bitboard_t MoveGenerator::GetPinned(const BoardComposite * board, uint8_t king) {
+	// Friendly pieces that block an enemy slider from the king are pinned
+	return GetBlockers<!IS_WHITE>(board, king) & (IS_WHITE ? board->white : board->black);
+}
+
+void MoveGenerator::GetCheckInfo(const BoardComposite * board, CheckInfo * info) {
+	if (board->state.white_to_move) GetCheckInfo<WHITE>(board, info);
+	else GetCheckInfo<BLACK>(board, info);
+}
+
+template <bool IS_WHITE>
+void MoveGenerator::GetCheckInfo(const BoardComposite * board, CheckInfo * info) {
+	uint8_t king = IS_WHITE ? board->bking_pos : board->wking_pos;
+	Bitboard_t all = board->white | board->black;
+	info->king = king;
+	if (king >= 64) {
+		for (int i = 0; i < 8; i++) info->check_squares[i] = 0;
+		info->discovered = 0;
+		return;
+	}
+	
+	// A pawn of the color to move attacks the king from wherever an enemy pawn
+	// on the king square would attack
+	info->check_squares[EMPTY] = 0;
+	info->check_squares[WHITE_PAWN] = IS_WHITE ? bp_masks[king] : wp_masks[king];
+	info->check_squares[WHITE_KNIGHT] = n_masks[king];
+	info->check_squares[WHITE_BISHOP] = GetBAttacks(all, king);
+	info->check_squares[WHITE_ROOK] = GetRAttacks(all, king);
+	info->check_squares[WHITE_QUEEN] = info->check_squares[WHITE_BISHOP] | info->check_squares[WHITE_ROOK];
+	info->check_squares[WHITE_KING] = 0;
+	info->check_squares[7] = 0;
+	
+	info->discovered = GetBlockers<IS_WHITE>(board, king) & (IS_WHITE ? board->white : board->black);
+}
+
+bool MoveGenerator::GivesCheck(const BoardComposite * board, Move move) {
+	CheckInfo info;
+	GetCheckInfo(board, &info);
+	return GivesCheck(board, move, info);
+}
+
+bool MoveGenerator::GivesCheck(const BoardComposite * board, Move move, const CheckInfo & info) {
+	if (board->state.white_to_move) return GivesCheck<WHITE>(board, move, info);
+	else return GivesCheck<BLACK>(board, move, info);
+}
+
+template <bool IS_WHITE>
+bool MoveGenerator::GivesCheck(const BoardComposite * board, Move move, const CheckInfo & info) {
+	if (info.king >= 64) return false;
+	const uint8_t color = IS_WHITE ? 0 : 8;
+	Bitboard_t king_bit = (Bitboard_t)1 << info.king;
+	Bitboard_t all = board->white | board->black;
+	
+	// Castling can only give check with the rook
+	if (move.code == (IS_WHITE ? Move::WHITE_OO : Move::BLACK_OO) || move.code == (IS_WHITE ? Move::WHITE_OOO : Move::BLACK_OOO)) {
+		const uint8_t rank = IS_WHITE ? 0 : 56;
+		bool is_OO = move.code == (IS_WHITE ? Move::WHITE_OO : Move::BLACK_OO);
+		uint8_t king_end = rank + (is_OO ? 6 : 2);
+		uint8_t rook_start = rank + (is_OO ? 7 : 0);
+		uint8_t rook_end = rank + (is_OO ? 5 : 3);
+		Bitboard_t after = all
+			^ ((Bitboard_t)1 << (rank + 4)) ^ ((Bitboard_t)1 << king_end)
+			^ ((Bitboard_t)1 << rook_start) ^ ((Bitboard_t)1 << rook_end);
+		return (GetRAttacks(after, rook_end) & king_bit) != 0;
+	}
+	
+	Bitboard_t start_bit = (Bitboard_t)1 << move.start;
+	Bitboard_t end_bit = (Bitboard_t)1 << move.end;
+	
+	// Direct check; a promoted piece may attack through the square the pawn left
+	if (move.code >= WHITE_KNIGHT + color && move.code <= WHITE_QUEEN + color) {
+		Bitboard_t after = (all ^ start_bit) | end_bit;
+		switch (move.code & 7) {
+			case WHITE_KNIGHT: if (n_masks[move.end] & king_bit) return true; break;
+			case WHITE_BISHOP: if (GetBAttacks(after, move.end) & king_bit) return true; break;
+			case WHITE_ROOK: if (GetRAttacks(after, move.end) & king_bit) return true; break;
+			case WHITE_QUEEN: if (GetQAttacks(after, move.end) & king_bit) return true; break;
 		}
 	}
+	else if (info.check_squares[board->state.squares[move.start] & 7] & end_bit) {
+		return true;
+	}
 	
+	// Discovered check by a piece leaving the line to the king
+	if ((info.discovered & start_bit) && !(line_masks[info.king][move.start] & end_bit)) {
+		return true;
+	}
+	
+	// En passant also removes the captured pawn, which can uncover a check
+	if (move.code == Move::EN_PASSANT) {
+		Bitboard_t after = (all ^ start_bit ^ ((Bitboard_t)1 << board->state.ep_target)) | end_bit;
+		Bitboard_t queens = board->pieces[WHITE_QUEEN + color];
+		return ((GetBAttacks(after, info.king) & (board->pieces[WHITE_BISHOP + color] | queens)) |
+			(GetRAttacks(after, info.king) & (board->pieces[WHITE_ROOK + color] | queens))) != 0;
+	}
 	return false;
 }
 
+bool MoveGenerator::IsPseudoLegal(const BoardComposite * board, Move move) {
+	if (board->state.white_to_move) return IsPseudoLegal<WHITE>(board, move);
+	else return IsPseudoLegal<BLACK>(board, move);
+}
+
+template <bool IS_WHITE>
+bool MoveGenerator::IsPseudoLegal(const BoardComposite * board, Move move) {
+	Bitboard_t friendly = IS_WHITE ? board->white : board->black;
+	Bitboard_t enemy = IS_WHITE ? board->black : board->white;
+	Bitboard_t all = friendly | enemy;
+	const uint8_t color = IS_WHITE ? 0 : 8;
+	
+	// Castling uses only the code; the conditions match GenerateMoves
+	if (move.code == (IS_WHITE ? Move::WHITE_OO : Move::BLACK_OO)) {
+		const uint8_t rank = IS_WHITE ? 0 : 56;
+		return (IS_WHITE ? board->state.white_OO : board->state.black_OO)
+			&& board->state.squares[rank + 4] == WHITE_KING + color
+			&& board->state.squares[rank + 7] == WHITE_ROOK + color
+			&& !(all & ((Bitboard_t)0x60 << rank));
+	}
+	if (move.code == (IS_WHITE ? Move::WHITE_OOO : Move::BLACK_OOO)) {
+		const uint8_t rank = IS_WHITE ? 0 : 56;
+		return (IS_WHITE ? board->state.white_OOO : board->state.black_OOO)
+			&& board->state.squares[rank + 4] == WHITE_KING + color
+			&& board->state.squares[rank + 0] == WHITE_ROOK + color
+			&& !(all & ((Bitboard_t)0x0e << rank));
+	}
+	
+	uint8_t start = move.start;
+	uint8_t end = move.end;
+	uint8_t piece = board->state.squares[start];
+	Bitboard_t end_bit = (Bitboard_t)1 << end;
+	
+	if (move.code == Move::EN_PASSANT) {
+		uint8_t ep_target = board->state.ep_target;
+		return ep_target && piece == WHITE_PAWN + color
+			&& (start == ep_target + 1 || start == ep_target - 1) && start / 8 == ep_target / 8
+			&& end == (IS_WHITE ? ep_target + 8 : ep_target - 8);
+	}
+	
+	if (piece == EMPTY || (piece & 8) != color || (friendly & end_bit)) return false;
+	
+	// Pawns must promote exactly when they reach the last rank
+	bool is_promotion = move.code >= WHITE_KNIGHT + color && move.code <= WHITE_QUEEN + color;
+	if (move.code != Move::NORMAL_MOVE && !is_promotion) return false;
+	if (piece == WHITE_PAWN + color) {
+		if (is_promotion != (start / 8 == (IS_WHITE ? 6 : 1))) return false;
+		return (GetPTargets<IS_WHITE>(all, enemy, start) & end_bit) != 0;
+	}
+	if (is_promotion) return false;
+	
+	switch (piece - color) {
+		case WHITE_KNIGHT: return (n_masks[start] & end_bit) != 0;
+		case WHITE_BISHOP: return (GetBAttacks(all, start) & end_bit) != 0;
+		case WHITE_ROOK: return (GetRAttacks(all, start) & end_bit) != 0;
+		case WHITE_QUEEN: return (GetQAttacks(all, start) & end_bit) != 0;
+		case WHITE_KING: return (k_masks[start] & end_bit) != 0;
+	}
+	return false;
+}
+
+bool MoveGenerator::IsLegal(const BoardComposite * board, Move move) {
+	if (board->state.white_to_move) return IsLegal<WHITE>(board, move);
+	else return IsLegal<BLACK>(board, move);
+}
+
+template <bool IS_WHITE>
+bool MoveGenerator::IsLegal(const BoardComposite * board, Move move) {
+	if (!IsPseudoLegal<IS_WHITE>(board, move)) return false;
+	
+	// Without a king, every pseudo-legal move is legal
+	uint8_t king = IS_WHITE ? board->wking_pos : board->bking_pos;
+	if (king >= 64) return true;
+	Bitboard_t all = board->white | board->black;
+	
+	if (move.code == (IS_WHITE ? Move::WHITE_OO : Move::BLACK_OO)) {
+		return !GetAttackers<!IS_WHITE>(board, king, all)
+			&& !GetAttackers<!IS_WHITE>(board, king + 1, all) && !GetAttackers<!IS_WHITE>(board, king + 2, all);
+	}
+	if (move.code == (IS_WHITE ? Move::WHITE_OOO : Move::BLACK_OOO)) {
+		return !GetAttackers<!IS_WHITE>(board, king, all)
+			&& !GetAttackers<!IS_WHITE>(board, king - 1, all) && !GetAttackers<!IS_WHITE>(board, king - 2, all);
+	}
+	
+	Bitboard_t start_bit = (Bitboard_t)1 << move.start;
+	Bitboard_t end_bit = (Bitboard_t)1 << move.end;
+	
+	// The king must not move to an attacked square, including one that was
+	// only shielded by the king itself
+	if (move.start == king) {
+		return !GetAttackers<!IS_WHITE>(board, move.end, all ^ start_bit);
+	}
+	
+	// Otherwise the king must not be attacked once the move is made; attackers
+	// that are captured do not count
+	Bitboard_t after = (all ^ start_bit) | end_bit;
+	Bitboard_t captured = end_bit;
+	if (move.code == Move::EN_PASSANT) {
+		captured = (Bitboard_t)1 << board->state.ep_target;
+		after ^= captured;
+	}
+	return !(GetAttackers<!IS_WHITE>(board, king, after) & ~captured);
+}
+
+Bitboard_t MoveGenerator::AttackersTo(const BoardComposite * board, uint8_t square, Bitboard_t occupancy) {
+	Bitboard_t queens = board->pieces[WHITE_QUEEN] | board->pieces[BLACK_QUEEN];
+	return
+		(n_masks[square] & (board->pieces[WHITE_KNIGHT] | board->pieces[BLACK_KNIGHT])) |
+		(k_masks[square] & (board->pieces[WHITE_KING] | board->pieces[BLACK_KING])) |
+		(bp_masks[square] & board->pieces[WHITE_PAWN]) |
+		(wp_masks[square] & board->pieces[BLACK_PAWN]) |
+		(GetBAttacks(occupancy, square) & (board->pieces[WHITE_BISHOP] | board->pieces[BLACK_BISHOP] | queens)) |
+		(GetRAttacks(occupancy, square) & (board->pieces[WHITE_ROOK] | board->pieces[BLACK_ROOK] | queens));
+}
+
+// The king is worth more than everything else together, so capturing with it
+// into a defended square is never chosen
+const Score_t MoveGenerator::SEE_VALUES[8] = { 0, 100, 300, 300, 500, 900, 10000, 0 };
+
+Score_t MoveGenerator::SEE(const BoardComposite * board, Move move) {
+	if (move.code >= Move::WHITE_OO && move.code <= Move::BLACK_OOO) return 0;
+	
+	uint8_t target = move.end;
+	Bitboard_t occupancy = (board->white | board->black) ^ ((Bitboard_t)1 << move.start);
+	
+	// Material won by each capture in the sequence, assuming it is recaptured
+	int gain[32];
+	int depth = 0;
+	uint8_t on_target = board->state.squares[move.start] & 7;
+	if (move.code == Move::EN_PASSANT) {
+		occupancy ^= (Bitboard_t)1 << board->state.ep_target;
+		gain[0] = SEE_VALUES[WHITE_PAWN];
+	}
+	else {
+		gain[0] = SEE_VALUES[board->state.squares[target] & 7];
+	}
+	if (move.code >= WHITE_KNIGHT && move.code <= BLACK_QUEEN) {
+		on_target = move.code & 7;
+		gain[0] += SEE_VALUES[on_target] - SEE_VALUES[WHITE_PAWN];
+	}
+	
+	// Alternate sides, each capturing with its least valuable attacker; sliders
+	// behind a piece that has captured join in as the occupancy is cleared
+	bool white = !board->state.white_to_move;
+	while (depth < 31) {
+		Bitboard_t attackers = AttackersTo(board, target, occupancy) & occupancy
+			& (white ? board->white : board->black);
+		if (!attackers) break;
+		
+		uint8_t color = white ? 0 : 8;
+		uint8_t piece = WHITE_PAWN;
+		while (!(attackers & board->pieces[piece + color])) piece++;
+		Bitboard_t attackers_of_type = attackers & board->pieces[piece + color];
+		
+		depth++;
+		gain[depth] = SEE_VALUES[on_target] - gain[depth - 1];
+		on_target = piece;
+		
+		// A pawn recapturing on the last rank promotes
+		if (piece == WHITE_PAWN && (target < 8 || target >= 56)) {
+			gain[depth] += SEE_VALUES[WHITE_QUEEN] - SEE_VALUES[WHITE_PAWN];
+			on_target = WHITE_QUEEN;
+		}
+		
+		occupancy ^= attackers_of_type & -attackers_of_type;
+		white = !white;
+	}
+	
+	// Either side may stop capturing when continuing would lose material
+	while (depth > 0) {
+		if (gain[depth] > -gain[depth - 1]) gain[depth - 1] = -gain[depth];
+		depth--;
+	}
+	return gain[0];
+}
+
+bool MoveGenerator::InCheck(const BoardComposite * board, bool is_white) {
+	return is_white ? InCheck<WHITE>(board) : InCheck<BLACK>(board);
+}
+
+template <bool IS_WHITE>
+bool MoveGenerator::InCheck(const BoardComposite * board) {
+	uint8_t king = IS_WHITE ? board->wking_pos : board->bking_pos;
+	if (king >= 64) return false;
+	return GetAttackers<!IS_WHITE>(board, king, board->white | board->black) != 0;
+}
+
+// Instantiate the color-specific routines that are called from other files
+template void MoveGenerator::GetMoves<WHITE>(const BoardComposite * board, MoveList * output);
+template void MoveGenerator::GetMoves<BLACK>(const BoardComposite * board, MoveList * output);
+template void MoveGenerator::GetLegalMoves<WHITE>(const BoardComposite * board, MoveList * output);
+template void MoveGenerator::GetLegalMoves<BLACK>(const BoardComposite * board, MoveList * output);
+template bool MoveGenerator::InCheck<WHITE>(const BoardComposite * board);
+template bool MoveGenerator::InCheck<BLACK>(const BoardComposite * board);
+
+MoveGenerator::Magic MoveGenerator::r_magics[64];
+MoveGenerator::Magic MoveGenerator::b_magics[64];
+Bitboard_t MoveGenerator::r_attacks[MoveGenerator::R_ATTACKS_SIZE];
+Bitboard_t MoveGenerator::b_attacks[MoveGenerator::B_ATTACKS_SIZE];
+Bitboard_t MoveGenerator::r_pext_attacks[MoveGenerator::R_ATTACKS_SIZE];
+Bitboard_t MoveGenerator::b_pext_attacks[MoveGenerator::B_ATTACKS_SIZE];
+bool MoveGenerator::use_pext = false;
+uint8_t MoveGenerator::emit_backend = MoveGenerator::EMIT_SCALAR;
+uint64_t MoveGenerator::byte_squares[256];
+
 CoordList MoveGenerator::row2list_table[256];
-CoordList MoveGenerator::friendly_table[256][8];
-CoordList MoveGenerator::enemy_table[256][8];
 
 Bitboard_t MoveGenerator::h_masks[64];
 Bitboard_t MoveGenerator::v_masks[64];
 Bitboard_t MoveGenerator::r_masks[64];
-Bitboard_t MoveGenerator::d1_masks[64];
-Bitboard_t MoveGenerator::d2_masks[64];
 Bitboard_t MoveGenerator::b_masks[64];
 Bitboard_t MoveGenerator::q_masks[64];
 Bitboard_t MoveGenerator::n_masks[64];
 Bitboard_t MoveGenerator::k_masks[64];
+Bitboard_t MoveGenerator::wp_masks[64];
+Bitboard_t MoveGenerator::bp_masks[64];
+Bitboard_t MoveGenerator::between_masks[64][64];
+Bitboard_t MoveGenerator::line_masks[64][64];
 
 Bitboard_t MoveGenerator::CoordList2Bitboard(CoordList coords) {
 	Bitboard_t output = 0;
@@ -556,175 +1282,291 @@ void MoveGenerator::Init() {
 			if (i & (1 << j)) row2list_table[i].coords[j] = j;
 			else row2list_table[i].coords[j] = 0x7f;
 		}
-		
-		for (int j = 0; j < 8; j++) {
-			enemy_table[i][j].data = 0x7f7f7f7f7f7f7f7f;
-			friendly_table[i][j].data = 0x7f7f7f7f7f7f7f7f;
-			for (int k = j - 1; k >= 0; k--) {
-				enemy_table[i][j].coords[k] = k;
-				if (i & (1 << k)) break;
-				else friendly_table[i][j].coords[k] = k;
-			}
-			
-			for (int k = j + 1; k < 8; k++) {
-				enemy_table[i][j].coords[k] = k;
-				if (i & (1 << k)) break;
-				else friendly_table[i][j].coords[k] = k;
-			}
-		}
 	}
 	
 	// Piece mask initialization
 	for (int i = 0; i < 64; i++) {
-		h_masks[i] = CoordList2Bitboard(GetHMoves(0, 0, i));
-		v_masks[i] = CoordList2Bitboard(GetVMoves(0, 0, i));
+		h_masks[i] = RayAttacks(i, 0, 0, 1) | RayAttacks(i, 0, 0, -1);
+		v_masks[i] = RayAttacks(i, 0, 1, 0) | RayAttacks(i, 0, -1, 0);
 		r_masks[i] = h_masks[i] | v_masks[i];
-		d1_masks[i] = CoordList2Bitboard(GetD1Moves(0, 0, i));
-		d2_masks[i] = CoordList2Bitboard(GetD2Moves(0, 0, i));
-		b_masks[i] = d1_masks[i] | d2_masks[i];
+		b_masks[i] = RayAttacks(i, 0, 1, 1) | RayAttacks(i, 0, -1, -1) | RayAttacks(i, 0, 1, -1) | RayAttacks(i, 0, -1, 1);
 		q_masks[i] = r_masks[i] | b_masks[i];
 		n_masks[i] = CoordList2Bitboard(GetNMoves(0, 0, i));
 		k_masks[i] = CoordList2Bitboard(GetKMoves(0, 0, i));
+		wp_masks[i] = RayAttacks(i, ~(Bitboard_t)0, 1, -1) | RayAttacks(i, ~(Bitboard_t)0, 1, 1);
+		bp_masks[i] = RayAttacks(i, ~(Bitboard_t)0, -1, -1) | RayAttacks(i, ~(Bitboard_t)0, -1, 1);
+	}
+	
+	// Between and line mask initialization
+	const int directions[8][2] = {
+		{0, 1}, {0, -1}, {1, 0}, {-1, 0}, {1, 1}, {-1, -1}, {1, -1}, {-1, 1} };
+	for (int i = 0; i < 64; i++) {
+		for (int j = 0; j < 64; j++) {
+			between_masks[i][j] = 0;
+			line_masks[i][j] = 0;
+		}
+		for (int d = 0; d < 8; d++) {
+			// Walk the ray; each square is on the line through i, and the ray
+			// blocked at that square gives the squares in between
+			Bitboard_t ray = RayAttacks(i, 0, directions[d][0], directions[d][1]);
+			Bitboard_t line = ray | RayAttacks(i, 0, -directions[d][0], -directions[d][1]) | ((Bitboard_t)1 << i);
+			Bitboard_t squares = ray;
+			while (squares) {
+				uint8_t j = PopLSB(squares);
+				between_masks[i][j] = RayAttacks(i, (Bitboard_t)1 << j, directions[d][0], directions[d][1]) & ~((Bitboard_t)1 << j);
+				line_masks[i][j] = line;
+			}
+		}
 	}
+	
+	// Attack tables for sliding pieces
+	InitMagics(r_magics, r_attacks, MAGIC_ROOK, true);
+	InitMagics(b_magics, b_attacks, MAGIC_BISHOP, false);
+	
+	// Switch to PEXT indexing only if the processor has it and both backends
+	// agree; otherwise stay with the portable magic lookups (see UsingPEXT)
+	#ifdef ARDALAN_PEXT
+	if (__builtin_cpu_supports("bmi2")) {
+		InitPEXT(r_magics, r_pext_attacks);
+		InitPEXT(b_magics, b_pext_attacks);
+		use_pext = CheckSliderBackends();
+	}
+	#endif
+	
+	// Squares of the set bits of each byte, for emitting moves eight target
+	// squares at a time
+	for (int i = 0; i < 256; i++) {
+		byte_squares[i] = 0;
+		int n = 0;
+		for (int j = 0; j < 8; j++) {
+			if (i & (1 << j)) byte_squares[i] |= (uint64_t)j << (8 * n++);
+		}
+	}
+	
+	// Use the widest emission backend the processor has, as long as it writes
+	// the same moves as the scalar loop (see GetEmitBackend)
+	#ifdef ARDALAN_SIMD_EMIT
+	const uint8_t emit_backends[2] = { EMIT_AVX2, EMIT_SSE4 };
+	for (int i = 0; i < 2; i++) {
+		if (!EmitBackendSupported(emit_backends[i])) continue;
+		emit_backend = emit_backends[i];
+		if (CheckEmitBackends()) break;
+		emit_backend = EMIT_SCALAR;
+	}
+	#endif
 }
 
-CoordList MoveGenerator::GetHMoves(Bitboard_t friendly, Bitboard_t enemy, uint8_t square) {
-	int shift = square & 56;
-	int file = square & 7;
-	CoordList f_shifted = friendly_table[(friendly >> shift) & 0xff][file];
-	CoordList e_shifted = enemy_table[(enemy >> shift) & 0xff][file];
-	CoordList output;
-	output.data = f_shifted.data | e_shifted.data; // Has same effect as | since empty bytes are 0xff
-	output.data += 0x0101010101010101 * shift;
-	return output;
+void MoveGenerator::InitMagics(Magic * magics, Bitboard_t * table, const uint64_t * magic_numbers, bool is_rook) {
+	const Bitboard_t FILE_EDGES = 0x8181818181818181;
+	const Bitboard_t RANK_EDGES = 0xff000000000000ff;
+	
+	Bitboard_t * attacks = table;
+	for (int square = 0; square < 64; square++) {
+		Magic & m = magics[square];
+		
+		// Relevant occupancy excludes the last square in each direction, since
+		// a piece there does not change which squares are attacked
+		if (is_rook) {
+			m.mask = (h_masks[square] & ~FILE_EDGES) | (v_masks[square] & ~RANK_EDGES);
+		}
+		else {
+			m.mask = b_masks[square] & ~(FILE_EDGES | RANK_EDGES);
+		}
+		m.magic = magic_numbers[square];
+		m.shift = 64 - __builtin_popcountll(m.mask);
+		m.attacks = attacks;
+		
+		// Enumerate every subset of the relevant occupancy (Carry-Rippler)
+		Bitboard_t occupancy = 0;
+		do {
+			Bitboard_t value = is_rook ?
+				RayAttacks(square, occupancy, 0, 1) | RayAttacks(square, occupancy, 0, -1) |
+				RayAttacks(square, occupancy, 1, 0) | RayAttacks(square, occupancy, -1, 0) :
+				RayAttacks(square, occupancy, 1, 1) | RayAttacks(square, occupancy, -1, -1) |
+				RayAttacks(square, occupancy, 1, -1) | RayAttacks(square, occupancy, -1, 1);
+			m.attacks[(occupancy * m.magic) >> m.shift] = value;
+			occupancy = (occupancy - m.mask) & m.mask;
+		} while (occupancy);
+		
+		attacks += (Bitboard_t)1 << (64 - m.shift);
+	}
 }
 
-CoordList MoveGenerator::GetVMoves(Bitboard_t friendly, Bitboard_t enemy, uint8_t square) {
-	int file = square & 7;
-	int rank = square / 8;
-	CoordList f_shifted = friendly_table[V2Row_Transform(friendly >> file)][rank];
-	CoordList e_shifted = enemy_table[V2Row_Transform(enemy >> file)][rank];
-	CoordList output;
-	output.data = f_shifted.data | e_shifted.data;
-	output.data += 0x312a231c150e0700;
-	output.data += 0x0101010101010101 * file;
-	return output;
+void MoveGenerator::InitPEXT(Magic * magics, Bitboard_t * table) {
+	Bitboard_t * attacks = table;
+	for (int square = 0; square < 64; square++) {
+		Magic & m = magics[square];
+		m.pext_attacks = attacks;
+		
+		// Copy each entry from the magic table into its PEXT position
+		Bitboard_t occupancy = 0;
+		do {
+			m.pext_attacks[SoftwarePext(occupancy, m.mask)] =
+				m.attacks[(occupancy * m.magic) >> m.shift];
+			occupancy = (occupancy - m.mask) & m.mask;
+		} while (occupancy);
+		
+		attacks += (Bitboard_t)1 << (64 - m.shift);
+	}
 }
 
-CoordList MoveGenerator::GetD1Moves(Bitboard_t friendly, Bitboard_t enemy, uint8_t square) {
-	int file = square & 7;
-	int rank = square / 8;
+bool MoveGenerator::CheckSliderBackends() {
+	#ifdef ARDALAN_PEXT
+	if (!__builtin_cpu_supports("bmi2")) return false;
 	
-	Bitboard_t f_shifted = friendly;
-	Bitboard_t e_shifted = enemy;
-	
-	// Variables depend upon the coord being on the top/bottom half of diagonal
-	int diff = 0;
-	Bitboard_t shift_back = 0;
-	int table_index = file;
-	
-	if (rank > file) {
-		diff = rank - file;
-		f_shifted = friendly >> (diff * 8);
-		e_shifted = enemy >> (diff * 8);
-		shift_back = 0x0808080808080808 * diff;
-		table_index = file;
-	} else if (file > rank) {
-		diff = file - rank;
-		f_shifted = friendly >> diff;
-		e_shifted = enemy >> diff;
-		shift_back = 0x0101010101010101 * diff;
-		table_index = rank;
-	}
-	
-	CoordList f_row = friendly_table[D12Row_Transform(f_shifted)][table_index];
-	CoordList e_row = enemy_table[D12Row_Transform(e_shifted)][table_index];
-	CoordList output;
-	output.data = f_row.data | e_row.data;
-	//			   Row to diagonal	    Offset from diag
-	output.data += 0x3830282018100800 + shift_back;
-	// Restrict the domain of the output
-	output.data |= ~(0xffffffffffffffff >> (diff * 8));
-	return output;
+	// Compare both backends for every relevant occupancy of every square
+	const Magic * all_magics[2] = { r_magics, b_magics };
+	for (int i = 0; i < 2; i++) {
+		for (int square = 0; square < 64; square++) {
+			const Magic & m = all_magics[i][square];
+			if (!m.pext_attacks) return false;
+			Bitboard_t occupancy = 0;
+			do {
+				Bitboard_t magic_value = m.attacks[(occupancy * m.magic) >> m.shift];
+				Bitboard_t pext_value = m.pext_attacks[Pext(occupancy, m.mask)];
+				if (magic_value != pext_value) return false;
+				occupancy = (occupancy - m.mask) & m.mask;
+			} while (occupancy);
+		}
+	}
+	return true;
+	#else
+	return false;
+	#endif
 }
 
-CoordList MoveGenerator::GetD2Moves(Bitboard_t friendly, Bitboard_t enemy, uint8_t square) {
-	int file = square & 7;
-	int rank = square / 8;
-	int shift_coef = rank + file - 7;
-	int table_index = file;
-	
-	Bitboard_t f_shifted = friendly;
-	Bitboard_t e_shifted = enemy;
-
-	/*
-	if (shift_coef > 0) {
-		f_shifted = friendly >> (shift_coef * 8);
-		e_shifted = enemy >> (shift_coef * 8);
-	} else if (shift_coef < 0) {
-		f_shifted = friendly << (-shift_coef * 8);
-		e_shifted = enemy << (-shift_coef * 8);
-	}
-	
-	CoordList f_row = friendly_table[D22Row_Transform(f_shifted)][file];
-	CoordList e_row = enemy_table[D22Row_Transform(e_shifted)][file];
-	CoordList output;
-	output.data = f_row.data | e_row.data;
-	//			   Row to diagonal	    Offset from diag
-	output.data += 0x0008101820283038;
-	if (shift_coef > 0) {
-		output.data += 0x0808080808080808 * shift_coef;
-		output.data |= ~(0xffffffffffffffff << (shift_coef * 8));
+bool MoveGenerator::EmitBackendSupported(uint8_t backend) {
+	if (backend == EMIT_SCALAR) return true;
+	#ifdef ARDALAN_SIMD_EMIT
+	__builtin_cpu_init();
+	if (!__builtin_cpu_supports("popcnt")) return false;
+	if (backend == EMIT_SSE4) return __builtin_cpu_supports("sse4.1");
+	if (backend == EMIT_AVX2) return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2");
+	#endif
+	return false;
+}
+
+bool MoveGenerator::SetEmitBackend(uint8_t backend) {
+	if (!EmitBackendSupported(backend)) return false;
+	emit_backend = backend;
+	return true;
+}
+
+bool MoveGenerator::CheckEmitBackends() {
+	// Every byte value in every byte of the board, then batches of
+	// pseudo-random target sets of all densities, with varying start squares
+	// and codes
+	const int N_RANDOM = 4096;
+	const int MAX_BATCH = 4;
+	uint64_t seed = 0x9e3779b97f4a7c15;
+	uint8_t starts[MAX_BATCH];
+	Bitboard_t target_lists[MAX_BATCH];
+	Move scalar_moves[64 * MAX_BATCH + MoveList::EMIT_SLACK];
+	Move backend_moves[64 * MAX_BATCH + MoveList::EMIT_SLACK];
+	for (int i = 0; i < 8 * 256 + N_RANDOM; i++) {
+		int n_target_lists = i < 8 * 256 ? 1 : i % (MAX_BATCH + 1);
+		for (int j = 0; j < n_target_lists; j++) {
+			seed ^= seed << 13;
+			seed ^= seed >> 7;
+			seed ^= seed << 17;
+			Bitboard_t targets = seed;
+			if (i < 8 * 256) targets = (Bitboard_t)(i % 256) << (8 * (i / 256));
+			else if (j % 4 == 1) targets &= seed >> 11;
+			else if (j % 4 == 2) targets &= (seed >> 11) & (seed >> 23);
+			else if (j % 4 == 3) targets |= seed << 29;
+			starts[j] = (i + j) % 64;
+			target_lists[j] = targets;
+		}
+		uint8_t code = i % 16;
+		
+		Move * scalar_end = EmitMovesScalar(scalar_moves, starts, target_lists, n_target_lists, code);
+		Move * backend_end = EmitMoves(backend_moves, starts, target_lists, n_target_lists, code);
+		if (scalar_end - scalar_moves != backend_end - backend_moves) return false;
+		for (int j = 0; j < scalar_end - scalar_moves; j++) {
+			if (!(scalar_moves[j] == backend_moves[j])) return false;
+		}
 	}
-	else {
-		output.data += 0x0808080808080808 * -shift_coef;
-		output.data |= ~(0xffffffffffffffff >> (-shift_coef * 8));
+	return true;
+}
+
+#ifdef ARDALAN_SIMD_EMIT
+static_assert(sizeof(Move) == 2, "Vectorized move emission requires two-byte moves");
+
+__attribute__((target("sse4.1,popcnt")))
+Move * MoveGenerator::EmitMovesSSE4(Move * output, const uint8_t * starts, const Bitboard_t * target_lists, int n_target_lists, uint8_t code) {
+	for (int i = 0; i < n_target_lists; i++) {
+		// A move is start | end << 6 | code << 12 in its two bytes
+		const __m128i base = _mm_set1_epi16(starts[i] | (code << 12));
+		Bitboard_t targets = target_lists[i];
+		if (__builtin_popcountll(targets) <= EMIT_SCALAR_MAX_TARGETS) {
+			output = EmitMovesScalar(output, starts + i, target_lists + i, 1, code);
+			continue;
+		}
+		while (targets) {
+			// Widen the squares of the set bits of the lowest nonzero byte into
+			// eight end fields, and keep as many as there are set bits
+			int shift = __builtin_ctzll(targets) & ~7;
+			uint8_t byte = targets >> shift;
+			__m128i ends = _mm_cvtepu8_epi16(_mm_cvtsi64_si128(byte_squares[byte]));
+			ends = _mm_add_epi16(ends, _mm_set1_epi16(shift));
+			_mm_storeu_si128((__m128i *)output, _mm_or_si128(_mm_slli_epi16(ends, 6), base));
+			output += __builtin_popcount(byte);
+			targets &= ~((Bitboard_t)0xff << shift);
+		}
 	}
-	std::cout << output << std::endl;
 	return output;
-	*/
-	
-	if (shift_coef > 0) {
-		f_shifted = friendly >> shift_coef;
-		e_shifted = enemy >> shift_coef;
-		table_index = 7 - rank;
-	} else if (shift_coef < 0) {
-		f_shifted = friendly << (-shift_coef * 8);
-		e_shifted = enemy << (-shift_coef * 8);
-		table_index = file;
+}
+
+__attribute__((target("avx2,bmi2,popcnt")))
+Move * MoveGenerator::EmitMovesAVX2(Move * output, const uint8_t * starts, const Bitboard_t * target_lists, int n_target_lists, uint8_t code) {
+	const __m128i low_nibbles = _mm_set1_epi8(0x0f);
+	for (int i = 0; i < n_target_lists; i++) {
+		const __m256i base = _mm256_set1_epi16(starts[i] | (code << 12));
+		Bitboard_t targets = target_lists[i];
+		if (__builtin_popcountll(targets) <= EMIT_SCALAR_MAX_TARGETS) {
+			output = EmitMovesScalar(output, starts + i, target_lists + i, 1, code);
+			continue;
+		}
+		while (targets) {
+			// Compress the squares 0-15, one per nibble, down to the set bits
+			// of the lowest nonzero sixteen-bit chunk
+			int shift = __builtin_ctzll(targets) & ~15;
+			uint64_t chunk = (targets >> shift) & 0xffff;
+			uint64_t nibbles = _pext_u64(0xfedcba9876543210, _pdep_u64(chunk, 0x1111111111111111) * 0xf);
+			
+			// Spread the nibbles to bytes in order, then widen them into
+			// sixteen end fields
+			__m128i packed = _mm_cvtsi64_si128(nibbles);
+			__m128i squares = _mm_unpacklo_epi8(_mm_and_si128(packed, low_nibbles),
+				_mm_and_si128(_mm_srli_epi16(packed, 4), low_nibbles));
+			__m256i ends = _mm256_add_epi16(_mm256_cvtepu8_epi16(squares), _mm256_set1_epi16(shift));
+			_mm256_storeu_si256((__m256i *)output, _mm256_or_si256(_mm256_slli_epi16(ends, 6), base));
+			output += __builtin_popcountll(chunk);
+			targets &= ~((Bitboard_t)0xffff << shift);
+		}
 	}
-	
-	//PrintBitboard(e_shifted);
-	
-	CoordList f_row = friendly_table[D22Row_Transform(f_shifted)][table_index];
-	CoordList e_row = enemy_table[D22Row_Transform(e_shifted)][table_index];
-	
-	//std::cout << e_row << std::endl;
-	
-	CoordList output;
-	output.data = f_row.data | e_row.data;
-	output.data += 0x0008101820283038;
-	
-	//std::cout << output << std::endl;
-	
-	if (shift_coef > 0) {
-		output.data += 0x0101010101010101 * shift_coef;
-		output.data |= ~(0xffffffffffffffff >> ((shift_coef) * 8));
-		//CoordList mask;
-		//mask.data = ~(0xffffffffffffffff >> ((shift_coef) * 8));
-		//std::cout << mask << std::endl;
-		//std::cout << output << std::endl;
-	} else if (shift_coef < 0) {
-		output.data -= 0x0808080808080808 * (-shift_coef);
-		output.data |= ~(0xffffffffffffffff >> ((-shift_coef) * 8));
-		//CoordList mask;
-		//mask.data = ~(0xffffffffffffffff >> ((shift_coef) * 8));
-		//std::cout << mask << std::endl;
-		//std::cout << output << std::endl;
+	return output;
+}
+#endif
+
+Bitboard_t MoveGenerator::SoftwarePext(Bitboard_t x, Bitboard_t mask) {
+	Bitboard_t output = 0;
+	for (Bitboard_t bit = 1; mask; bit <<= 1) {
+		if (x & mask & -mask) output |= bit;
+		mask &= mask - 1;
+	}
+	return output;
+}
+
+Bitboard_t MoveGenerator::RayAttacks(uint8_t square, Bitboard_t occupancy, int d_rank, int d_file) {
+	Bitboard_t output = 0;
+	int rank = square / 8 + d_rank;
+	int file = square % 8 + d_file;
+	for (; rank >= 0 && rank < 8 && file >= 0 && file < 8; rank += d_rank, file += d_file) {
+		Bitboard_t bit = (Bitboard_t)1 << (rank * 8 + file);
+		output |= bit;
+		if (occupancy & bit) break;
 	}
-	
-	//std::cout << output << std::endl;
-	
 	return output;
 }
 
@@ -798,72 +1640,20 @@ CoordList MoveGenerator::GetKMoves(Bitboard_t friendly, Bitboard_t enemy, uint8_
 	return row;
 }
 
-CoordList MoveGenerator::GetWPMoves(Bitboard_t friendly, Bitboard_t enemy, uint8_t square) {
-	int file = square & 7;
-	int rank = square / 8;
-	
-	CoordList output;
-	if (~(friendly | enemy) & ((Bitboard_t)1 << (square + 8))) {
-		output.coords[0] = square + 8;
-		if (rank == 1 && (~(friendly | enemy) & ((Bitboard_t)1 << (square + 16)))) {
-			output.coords[1] = square + 16;
-		}
-	}
-	
-	if (file != 0 && (enemy & ((Bitboard_t)1 << (square + 7)))) {
-		output.coords[2] = square + 7;
-	}
-	if (file != 7 && (enemy & ((Bitboard_t)1 << (square + 9)))) {
-		output.coords[3] = square + 9;
+template <bool IS_WHITE>
+Bitboard_t MoveGenerator::GetPTargets(Bitboard_t all, Bitboard_t enemy, uint8_t square) {
+	Bitboard_t empty = ~all;
+	Bitboard_t bit = (Bitboard_t)1 << square;
+	if (IS_WHITE) {
+		Bitboard_t push = (bit << 8) & empty;
+		push |= ((push & 0x0000000000ff0000) << 8) & empty;
+		return push | (wp_masks[square] & enemy);
 	}
-	
-	return output;
-}
-
-CoordList MoveGenerator::GetBPMoves(Bitboard_t friendly, Bitboard_t enemy, uint8_t square) {
-	int file = square & 7;
-	int rank = square / 8;
-	
-	CoordList output;
-	if (~(friendly | enemy) & ((Bitboard_t)1 << (square - 8))) {
-		output.coords[0] = square - 8;
-		if (rank == 6 && (~(friendly | enemy) & ((Bitboard_t)1 << (square - 16)))) {
-			output.coords[1] = square - 16;
-		}
-	}
-	
-	if (file != 0 && (enemy & ((Bitboard_t)1 << (square - 9)))) {
-		output.coords[2] = square - 9;
-	}
-	if (file != 7 && (enemy & ((Bitboard_t)1 << (square - 7)))) {
-		output.coords[3] = square - 7;
+	else {
+		Bitboard_t push = (bit >> 8) & empty;
+		push |= ((push & 0x0000ff0000000000) >> 8) & empty;
+		return push | (bp_masks[square] & enemy);
 	}
-	
-	return output;
-}
-
-Bitboard_t MoveGenerator::V2Row_Transform(Bitboard_t x) {
-	x &= 0x0101010101010101;
-	x |= (x & 0xffffffff00000000) >> 28;
-	x |= (x & 0x00000000ffff0000) >> 14;
-	x |= (x & 0x000000000000ff00) >> 7;
-	return x & 0xff;
-}
-
-Bitboard_t MoveGenerator::D12Row_Transform(Bitboard_t x) {
-	x &= 0x8040201008040201;
-	x |= (x & 0xffffffff00000000) >> 32;
-	x |= (x & 0x00000000ffff0000) >> 16;
-	x |= (x & 0x000000000000ff00) >> 8;
-	return x & 0xff;
-}
-
-Bitboard_t MoveGenerator::D22Row_Transform(Bitboard_t x) {
-	x &= 0x0102040810204080;
-	x |= (x & 0xffffffff00000000) >> 32;
-	x |= (x & 0x00000000ffff0000) >> 16;
-	x |= (x & 0x000000000000ff00) >> 8;
-	return x & 0xff;
 }
 
 Bitboard_t MoveGenerator::N2Row_Transform(Bitboard_t x) {
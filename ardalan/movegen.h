@@ -3,7 +3,23 @@
 
 #include "datatypes.h"
 
+#include <string.h>
+
+// The PEXT slider backend uses inline assembly, and is only selected at runtime
+// if the processor reports BMI2 support
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(ARDALAN_NO_PEXT)
+#define ARDALAN_PEXT
+#endif
+
+// Vectorized move emission uses SSE4.1, or AVX2 with BMI2, and each is only
+// selected at runtime if the processor reports support
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(ARDALAN_NO_SIMD_EMIT)
+#define ARDALAN_SIMD_EMIT
+#endif
+
 class MoveGenerator {
+	friend class StagedMoveGenerator;
+	
 public:
 	MoveGenerator();
 	
@@ -11,40 +27,498 @@ public:
 	void GetMoves(const BoardComposite * board, MoveList * output);
 	MoveList GetUnmoves(const BoardComposite * board);
 	void GetUnmoves(const BoardComposite * board, MoveList * output);
+	
+	/**
+	 * @brief Generate every way back to a position that could have preceded this one.
+	 * @param board Position to generate unmoves from.
+	 * @param output Vector to fill.
+	 * @param max_material Most pieces of each kind the earlier position may
+	 * have; uncaptures and unpromotions that would exceed it are skipped.
+	 * 
+	 * Unlike the unmoves above, these include pawn retreats, unpromotions,
+	 * uncaptures (en passant too) and castling. They are pseudo-legal, so the
+	 * color to move may be in check in the earlier position. A king or rook
+	 * whose castling right is still held is never moved back. Where the
+	 * earlier position could also have held castling rights that the move
+	 * lost, or an en passant target from a double push just before it, each
+	 * such variant is a separate unmove.
+	 */
+	void GetUnmoves(const BoardComposite * board, std::vector<Unmove> * output, Material_t max_material);
+	
+	/**
+	 * @brief Generate the unmoves that lead back to legal positions.
+	 * @param board Position to generate unmoves from.
+	 * @param unmoves Vector to fill with the legal unmoves.
+	 * @param earlier Vector to fill with the position before each unmove, in
+	 * the same order; may be NULL if only the unmoves are needed.
+	 * @param max_material Most pieces of each kind the earlier position may have.
+	 * 
+	 * The color that moved cannot have left the other king in check, so the
+	 * attackers of that king are found in each earlier position from the
+	 * piece bitboards of this one, with the moved piece and the occupancy
+	 * adjusted, rather than by building the earlier position.
+	 */
+	void GetLegalUnmoves(const BoardComposite * board, std::vector<Unmove> * unmoves,
+		std::vector<BoardState> * earlier, Material_t max_material);
+	
+	/**
+	 * @brief Build the position from before an unmove.
+	 * @param state Position that the unmove was generated from.
+	 * @param unmove Unmove to take back.
+	 * @param output Output for the earlier position.
+	 */
+	static void MakeUnmove(const BoardState & state, Unmove unmove, BoardState * output);
 	bool InCheck(const BoardComposite * board, bool is_white);
 	
+	/**
+	 * @brief Color-specific versions of the routines above.
+	 * 
+	 * The color is a template argument (WHITE or BLACK), so the choices between
+	 * colors are made at compile time. GetMoves and GetLegalMoves expect that
+	 * color to be the one to move; the versions without a template argument
+	 * check the board and call one of these.
+	 */
+	template <bool IS_WHITE> void GetMoves(const BoardComposite * board, MoveList * output);
+	template <bool IS_WHITE> void GetLegalMoves(const BoardComposite * board, MoveList * output);
+	template <bool IS_WHITE> bool InCheck(const BoardComposite * board);
+	
+	/**
+	 * @brief Generate only the legal moves for whichever color is to move.
+	 * @param board Position to generate moves from.
+	 * @param output List to fill.
+	 * 
+	 * Checkers, pinned pieces and the squares that resolve a check are found
+	 * up front, so no move needs to be made and unmade to test for check.
+	 */
+	MoveList GetLegalMoves(const BoardComposite * board);
+	void GetLegalMoves(const BoardComposite * board, MoveList * output);
+	
+	// Kinds of moves that can be requested from the selective generator
+	//		CAPTURES: captures, en passant and queen promotions
+	//		QUIETS: non-capturing moves other than promotions, including castling
+	//		UNDERPROMOTIONS: promotions to knight, bishop or rook
+	//		EVASIONS: generate nothing unless the color to move is in check
+	//		QUIET_CHECKS: only generate the quiet moves that give check
+	static const uint8_t CAPTURES = 1;
+	static const uint8_t QUIETS = 2;
+	static const uint8_t UNDERPROMOTIONS = 4;
+	static const uint8_t ALL_MOVES = CAPTURES | QUIETS | UNDERPROMOTIONS;
+	static const uint8_t EVASIONS = 8;
+	static const uint8_t QUIET_CHECKS = 16;
+	
+	/**
+	 * @brief Generate a subset of the legal moves for whichever color is to move.
+	 * @param board Position to generate moves from.
+	 * @param output List to fill.
+	 * @param kinds Combination of the kinds listed above.
+	 * @param from Only generate moves of pieces on these squares.
+	 */
+	void GetLegalMoves(const BoardComposite * board, MoveList * output, uint8_t kinds, Bitboard_t from = ~(Bitboard_t)0);
+	
+	/**
+	 * @brief Generate the legal captures and queen promotions for quiescence search.
+	 * @param board Position to generate moves from.
+	 * @param output List to fill.
+	 */
+	void GetCaptures(const BoardComposite * board, MoveList * output);
+	
+	/**
+	 * @brief Generate the legal replies to a check: king moves, blocks, and
+	 * captures of the checking piece.
+	 * @param board Position to generate moves from.
+	 * @param output List to fill; left empty if the color to move is not in check.
+	 */
+	void GetEvasions(const BoardComposite * board, MoveList * output);
+	
+	/**
+	 * @brief Generate the legal moves of many unrelated positions at once.
+	 * @param boards Positions to generate moves from.
+	 * @param n_boards Number of positions.
+	 * @param output Batch to fill, with one entry per position in order.
+	 * @param n_threads Number of worker threads; 0 to use one per core.
+	 * 
+	 * Positions are split into contiguous ranges, one per thread, and each
+	 * thread works through its range a block at a time so that the next block
+	 * is already being loaded while moves are generated for the current one.
+	 * Positions given as Board States are built into Board Composites block by
+	 * block first.
+	 */
+	void GetLegalMoves(const BoardComposite * boards, size_t n_boards, MoveBatch * output, unsigned n_threads = 1);
+	void GetLegalMoves(const BoardState * states, size_t n_states, MoveBatch * output, unsigned n_threads = 1);
+	
+	/**
+	 * @brief Count the legal moves without writing them to a list.
+	 * @param board Position to count moves from.
+	 * @return Number of moves GetLegalMoves would generate.
+	 */
+	int CountLegalMoves(const BoardComposite * board);
+	
+	/**
+	 * @brief Determine whether the color to move has a legal move, stopping at
+	 * the first one found.
+	 * @param board Position to look at.
+	 */
+	bool HasAnyLegalMove(const BoardComposite * board);
+	
+	/**
+	 * @brief Generate the legal quiet moves that give check, for quiescence search.
+	 * @param board Position to generate moves from.
+	 * @param output List to fill.
+	 */
+	void GetQuietChecks(const BoardComposite * board, MoveList * output);
+	
+	/**
+	 * @brief What the color to move needs to know to find moves that give check.
+	 */
+	struct CheckInfo {
+		// Square of the enemy king (255 if there is none)
+		uint8_t king;
+		
+		// Squares from which each type of piece would attack the enemy king,
+		// indexed by piece type without color
+		Bitboard_t check_squares[8];
+		
+		// Pieces of the color to move that uncover a check from one of their
+		// sliders when they leave the line to the enemy king
+		Bitboard_t discovered;
+	};
+	
+	void GetCheckInfo(const BoardComposite * board, CheckInfo * info);
+	
+	/**
+	 * @brief Determine whether a legal move gives check, without making it.
+	 * @param board Position the move is made from.
+	 * @param move Move of the color to move.
+	 * @param info Check info from GetCheckInfo, to share between many moves
+	 * from the same position.
+	 */
+	bool GivesCheck(const BoardComposite * board, Move move);
+	bool GivesCheck(const BoardComposite * board, Move move, const CheckInfo & info);
+	
+	/**
+	 * @brief Determine whether a move could be generated by GetMoves, without
+	 * generating any moves.
+	 * @param board Position the move would be made from.
+	 * @param move Move to check, for example a hash or killer move.
+	 */
+	bool IsPseudoLegal(const BoardComposite * board, Move move);
+	
+	/**
+	 * @brief Determine whether a move could be generated by GetLegalMoves,
+	 * without generating any moves.
+	 * @param board Position the move would be made from.
+	 * @param move Move to check, for example a hash or killer move.
+	 * 
+	 * The king is tested against the attackers of its square with the moving
+	 * piece (and any captured piece) taken off, which covers pins and checks.
+	 */
+	bool IsLegal(const BoardComposite * board, Move move);
+	
+	/**
+	 * @brief Get the pieces of both colors that attack a square.
+	 * @param board Position to look at.
+	 * @param square Square being attacked.
+	 * @param occupancy Pieces that block sliding attacks; clear squares here to
+	 * look through pieces that have moved away.
+	 * @return Attacking pieces. Pieces come from the board, so mask the result
+	 * with the occupancy to drop pieces that are considered removed.
+	 */
+	Bitboard_t AttackersTo(const BoardComposite * board, uint8_t square, Bitboard_t occupancy);
+	
+	// Piece values in centipawns used by the static exchange evaluator,
+	// indexed by piece type without color
+	static const Score_t SEE_VALUES[8];
+	
+	/**
+	 * @brief Static exchange evaluation of a move.
+	 * @param board Position the move is made from.
+	 * @param move Capture (or any other move) of the color to move.
+	 * @return Material the color to move wins from the sequence of captures on
+	 * the target square, if both sides always recapture with their least
+	 * valuable piece and may stop whenever continuing would lose material.
+	 * 
+	 * Pins and checks are not considered; castling scores zero.
+	 */
+	Score_t SEE(const BoardComposite * board, Move move);
+	
+	/**
+	 * @brief Get the squares attacked by a rook on a square.
+	 * @param occupancy All pieces on the board (both colors).
+	 * @param square Square of the rook.
+	 * @return Attacked squares, including the first blocker in each direction.
+	 */
+	static inline Bitboard_t GetRAttacks(Bitboard_t occupancy, uint8_t square) {
+		const Magic & m = r_magics[square];
+		#ifdef ARDALAN_PEXT
+		if (use_pext) return m.pext_attacks[Pext(occupancy, m.mask)];
+		#endif
+		return m.attacks[((occupancy & m.mask) * m.magic) >> m.shift];
+	}
+	
+	/**
+	 * @brief Get the squares attacked by a bishop on a square.
+	 * @param occupancy All pieces on the board (both colors).
+	 * @param square Square of the bishop.
+	 * @return Attacked squares, including the first blocker in each direction.
+	 */
+	static inline Bitboard_t GetBAttacks(Bitboard_t occupancy, uint8_t square) {
+		const Magic & m = b_magics[square];
+		#ifdef ARDALAN_PEXT
+		if (use_pext) return m.pext_attacks[Pext(occupancy, m.mask)];
+		#endif
+		return m.attacks[((occupancy & m.mask) * m.magic) >> m.shift];
+	}
+	
+	static inline Bitboard_t GetQAttacks(Bitboard_t occupancy, uint8_t square) {
+		return GetRAttacks(occupancy, square) | GetBAttacks(occupancy, square);
+	}
+	
+	/**
+	 * @brief Determine whether slider attacks are indexed with PEXT.
+	 * @return True if the processor supports BMI2 and the PEXT tables passed
+	 * the self-check against the magic tables.
+	 */
+	static inline bool UsingPEXT() {
+		return use_pext;
+	}
+	
+	static bool CheckSliderBackends();
+	
+	// Ways of writing the moves of a piece to a list
+	//		EMIT_SCALAR: one move per set bit of the targets
+	//		EMIT_SSE4: eight squares at a time, widened from a table of set bits
+	//		EMIT_AVX2: sixteen squares at a time, compressed with PEXT
+	static const uint8_t EMIT_SCALAR = 0;
+	static const uint8_t EMIT_SSE4 = 1;
+	static const uint8_t EMIT_AVX2 = 2;
+	
+	/**
+	 * @brief Get the move emission backend in use.
+	 * @return The widest backend the processor supports that passed the
+	 * self-check against scalar emission.
+	 */
+	static inline uint8_t GetEmitBackend() {
+		return emit_backend;
+	}
+	
+	/**
+	 * @brief Determine whether the processor can use a move emission backend.
+	 */
+	static bool EmitBackendSupported(uint8_t backend);
+	
+	/**
+	 * @brief Choose the move emission backend, for example to compare them.
+	 * @return False (and no change) if the processor cannot use the backend.
+	 */
+	static bool SetEmitBackend(uint8_t backend);
+	
+	/**
+	 * @brief Compare every supported emission backend with the scalar one.
+	 * @return True if all of them write the same moves.
+	 */
+	static bool CheckEmitBackends();
+	
 protected:
-	CoordList GetHMoves(Bitboard_t friendly, Bitboard_t enemy, uint8_t square);
-	CoordList GetVMoves(Bitboard_t friendly, Bitboard_t enemy, uint8_t square);
-	CoordList GetD1Moves(Bitboard_t friendly, Bitboard_t enemy, uint8_t square);
-	CoordList GetD2Moves(Bitboard_t friendly, Bitboard_t enemy, uint8_t square);
 	CoordList GetNMoves(Bitboard_t friendly, Bitboard_t enemy, uint8_t square);
 	CoordList GetKMoves(Bitboard_t friendly, Bitboard_t enemy, uint8_t square);
-	CoordList GetWPMoves(Bitboard_t friendly, Bitboard_t enemy, uint8_t square);
-	CoordList GetBPMoves(Bitboard_t friendly, Bitboard_t enemy, uint8_t square);
+	template <bool IS_WHITE> Bitboard_t GetPTargets(Bitboard_t all, Bitboard_t enemy, uint8_t square);
+	
+	/**
+	 * @brief Generate moves into a list, or only count them if the list is NULL.
+	 * @return Number of moves generated.
+	 */
+	int GenerateMoves(const BoardComposite * board, MoveList * output, bool legal, uint8_t kinds, Bitboard_t from);
+	template <bool IS_WHITE> int GenerateMoves(const BoardComposite * board, MoveList * output, bool legal, uint8_t kinds, Bitboard_t from);
+	template <bool IS_WHITE> bool HasAnyLegalMove(const BoardComposite * board);
+	Bitboard_t GetAttackers(const BoardComposite * board, uint8_t square, Bitboard_t occupancy, bool by_white);
+	template <bool BY_WHITE> Bitboard_t GetAttackers(const BoardComposite * board, uint8_t square, Bitboard_t occupancy);
+	template <bool SNIPER_WHITE> Bitboard_t GetBlockers(const BoardComposite * board, uint8_t king);
+	template <bool IS_WHITE> Bitboard_t GetPinned(const BoardComposite * board, uint8_t king);
+	template <bool IS_WHITE> void GetCheckInfo(const BoardComposite * board, CheckInfo * info);
+	template <bool IS_WHITE> bool GivesCheck(const BoardComposite * board, Move move, const CheckInfo & info);
+	template <bool IS_WHITE> bool IsPseudoLegal(const BoardComposite * board, Move move);
+	template <bool IS_WHITE> bool IsLegal(const BoardComposite * board, Move move);
+	
+	template <bool BY_WHITE>
+	void GenerateUnmoves(const BoardComposite * board, std::vector<Unmove> * output, Material_t max_material);
+	
+	/**
+	 * @brief Determine whether the earlier position of an unmove by the given
+	 * color leaves the king of the other color out of check.
+	 */
+	template <bool BY_WHITE>
+	bool IsLegalUnmove(const BoardComposite * board, const Unmove & unmove);
+	
+	/**
+	 * @brief Add the unmoves of a piece from each square it could have come
+	 * from, once without a capture (if allowed) and once per uncapture.
+	 */
+	static void AddUnmoves(std::vector<Unmove> * output, uint8_t square, Bitboard_t from, uint8_t code,
+		Material_t material, bool quiet, const uint8_t * uncaptures, int n_uncaptures);
+	
+	/**
+	 * @brief Add a variant of each unmove for every combination of castling
+	 * rights and en passant target that its earlier position could also have.
+	 */
+	static void AddRightsUnmoves(const BoardState & state, std::vector<Unmove> * output);
+	
+	// Number of positions loaded at a time by batched generation
+	static const int BATCH_BLOCK = 8;
+	
+	/**
+	 * @brief Generate the legal moves of a range of positions of a batch.
+	 * @param moves Output for the moves of every position in the range.
+	 * @param lengths Output for the number of moves of each position.
+	 * @return Whether the moves of any position did not fit in a move list.
+	 */
+	bool GenerateBatch(const BoardComposite * boards, size_t begin, size_t end, std::vector<Move> * moves, uint32_t * lengths);
+	bool GenerateBatch(const BoardState * states, size_t begin, size_t end, std::vector<Move> * moves, uint32_t * lengths);
+	
+	template <typename Position>
+	void GenerateBatch(const Position * positions, size_t n_positions, MoveBatch * output, unsigned n_threads);
+	
+	/**
+	 * @brief Clear target squares until the moves to them fit in a capacity,
+	 * setting the truncated flag if any had to be cleared.
+	 * @return Number of moves the remaining targets produce.
+	 */
+	static int LimitTargets(Bitboard_t * target_lists, int n_target_lists, int capacity, int moves_per_target, bool * truncated);
+	
+	/**
+	 * @brief Get the squares a piece other than the king can move to in order
+	 * to resolve the checks from some checkers (all squares if there are none).
+	 */
+	inline Bitboard_t GetEvasionSquares(uint8_t king, Bitboard_t checkers) {
+		if (!checkers) return ~(Bitboard_t)0;
+		// Only the king can move out of a double check
+		if (checkers & (checkers - 1)) return 0;
+		return checkers | between_masks[king][__builtin_ctzll(checkers)];
+	}
+	
+	/**
+	 * @brief Get the quiet targets of a piece that move it off the line of a
+	 * check it would uncover.
+	 */
+	inline Bitboard_t GetDiscoveryTargets(const CheckInfo & info, uint8_t square, Bitboard_t quiet_mask) {
+		if (!(info.discovered & ((Bitboard_t)1 << square))) return 0;
+		return quiet_mask & ~line_masks[info.king][square];
+	}
+	
+	/**
+	 * @brief Write one move for each target square of each piece.
+	 * @param starts Square of each piece.
+	 * @param target_lists Target squares of each piece.
+	 * @return Pointer past the last move written.
+	 * 
+	 * The vectorized backends store a whole batch of moves at a time, so up to
+	 * MoveList::EMIT_SLACK moves past the returned pointer may be overwritten.
+	 */
+	static inline Move * EmitMoves(Move * output, const uint8_t * starts, const Bitboard_t * target_lists, int n_target_lists, uint8_t code) {
+		#ifdef ARDALAN_SIMD_EMIT
+		if (emit_backend == EMIT_AVX2) return EmitMovesAVX2(output, starts, target_lists, n_target_lists, code);
+		if (emit_backend == EMIT_SSE4) return EmitMovesSSE4(output, starts, target_lists, n_target_lists, code);
+		#endif
+		return EmitMovesScalar(output, starts, target_lists, n_target_lists, code);
+	}
+	
+	static inline Move * EmitMovesScalar(Move * output, const uint8_t * starts, const Bitboard_t * target_lists, int n_target_lists, uint8_t code) {
+		for (int i = 0; i < n_target_lists; i++) {
+			Bitboard_t targets = target_lists[i];
+			#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+			// A move is start | end << 6 | code << 12 in its two bytes, so it
+			// can be written in one store rather than three bitfield updates
+			uint16_t base = starts[i] | (code << 12);
+			while (targets) {
+				uint16_t move = base | (PopLSB(targets) << 6);
+				memcpy((void *)output++, &move, sizeof(move));
+			}
+			#else
+			while (targets) {
+				output->start = starts[i];
+				output->end = PopLSB(targets);
+				output->code = code;
+				output++;
+			}
+			#endif
+		}
+		return output;
+	}
+	
+	#ifdef ARDALAN_SIMD_EMIT
+	// Most pieces have only a few targets, which are cheaper to write one at a
+	// time than to set up a vector for
+	static const int EMIT_SCALAR_MAX_TARGETS = 8;
+	
+	static Move * EmitMovesSSE4(Move * output, const uint8_t * starts, const Bitboard_t * target_lists, int n_target_lists, uint8_t code);
+	static Move * EmitMovesAVX2(Move * output, const uint8_t * starts, const Bitboard_t * target_lists, int n_target_lists, uint8_t code);
+	#endif
 	
 protected:
+	/**
+	 * @brief Fancy magic lookup data for one square.
+	 * 
+	 * The relevant occupancy is multiplied by the magic and shifted to form an
+	 * index into this square's block of the shared attack table. With BMI2, the
+	 * relevant occupancy bits are instead extracted directly with PEXT to index
+	 * a second table holding the same attacks in a different order.
+	 */
+	struct Magic {
+		Bitboard_t mask;
+		Bitboard_t magic;
+		Bitboard_t * attacks;
+		Bitboard_t * pext_attacks;
+		uint8_t shift;
+	};
+	
+	static const int R_ATTACKS_SIZE = 102400;
+	static const int B_ATTACKS_SIZE = 5248;
+	
+	static Magic r_magics[64];
+	static Magic b_magics[64];
+	static Bitboard_t r_attacks[R_ATTACKS_SIZE];
+	static Bitboard_t b_attacks[B_ATTACKS_SIZE];
+	static Bitboard_t r_pext_attacks[R_ATTACKS_SIZE];
+	static Bitboard_t b_pext_attacks[B_ATTACKS_SIZE];
+	static bool use_pext;
+	
+	static uint8_t emit_backend;
+	
+	// Squares of the set bits of each byte, one per byte from the lowest
+	static uint64_t byte_squares[256];
+	
 	static CoordList row2list_table[256];
-	static CoordList friendly_table[256][8];
-	static CoordList enemy_table[256][8];
 	
 	static Bitboard_t h_masks[64];
 	static Bitboard_t v_masks[64];
 	static Bitboard_t r_masks[64];
-	static Bitboard_t d1_masks[64];
-	static Bitboard_t d2_masks[64];
 	static Bitboard_t b_masks[64];
 	static Bitboard_t q_masks[64];
 	static Bitboard_t n_masks[64];
 	static Bitboard_t k_masks[64];
+	static Bitboard_t wp_masks[64];
+	static Bitboard_t bp_masks[64];
+	static Bitboard_t between_masks[64][64];
+	static Bitboard_t line_masks[64][64];
 	
 	static Bitboard_t CoordList2Bitboard(CoordList coords);
 	
+	/**
+	 * @brief Build the static tables; only called once, by the first generator constructed.
+	 */
 	void Init();
+	static void InitMagics(Magic * magics, Bitboard_t * table, const uint64_t * magic_numbers, bool is_rook);
+	static void InitPEXT(Magic * magics, Bitboard_t * table);
+	static Bitboard_t SoftwarePext(Bitboard_t x, Bitboard_t mask);
+	
+	#ifdef ARDALAN_PEXT
+	static inline Bitboard_t Pext(Bitboard_t x, Bitboard_t mask) {
+		Bitboard_t output;
+		asm ("pextq %2, %1, %0" : "=r" (output) : "r" (x), "rm" (mask));
+		return output;
+	}
+	#endif
 	
-	static Bitboard_t V2Row_Transform(Bitboard_t x);
-	static Bitboard_t D12Row_Transform(Bitboard_t x);
-	static Bitboard_t D22Row_Transform(Bitboard_t x);
+	static Bitboard_t RayAttacks(uint8_t square, Bitboard_t occupancy, int d_rank, int d_file);
 	static Bitboard_t N2Row_Transform(Bitboard_t x);
 	static Bitboard_t K2Row_Transform(Bitboard_t x);
 };
@@ -0,0 +1,190 @@
+#include "board.h"
+#include "perft.h"
+
+#include <atomic>
+#include <string.h>
+#include <thread>
+
+uint64_t Board::Perft(uint8_t depth) {
+	if (depth == 0) return 1;
+	
+	// Leaves only need the number of moves
+	if (depth == 1) return CountLegalMoves();
+	
+	// The legal move list stays valid while children are made in the next
+	// Board Composite
+	const MoveList * moves = GetLegalMoves();
+	
+	uint64_t n_nodes = 0;
+	const Move * move_i = moves->Begin();
+	const Move * move_end = moves->End();
+	for (; move_i != move_end; move_i++) {
+		Make(*move_i);
+		n_nodes += Perft(depth - 1);
+		Unmake(1);
+	}
+	return n_nodes;
+}
+
+uint64_t Board::PerftInPlace(uint8_t depth) {
+	if (depth == 0) return 1;
+	std::vector<MoveList> lists(depth);
+	return PerftInPlace(depth, lists.data());
+}
+
+uint64_t Board::PerftInPlace(uint8_t depth, MoveList * lists) {
+	if (depth == 1) return mgen.CountLegalMoves(current);
+	
+	// The position changes under each move, so the moves are kept outside of
+	// the Board Composite cache
+	MoveList * moves = &lists[depth - 1];
+	mgen.GetLegalMoves(current, moves);
+	
+	Undo undo;
+	uint64_t n_nodes = 0;
+	const Move * move_i = moves->Begin();
+	const Move * move_end = moves->End();
+	for (; move_i != move_end; move_i++) {
+		MakeInPlace(*move_i, &undo);
+		n_nodes += PerftInPlace(depth - 1, lists);
+		UnmakeInPlace(undo);
+	}
+	return n_nodes;
+}
+
+std::vector<std::pair<Move, uint64_t>> Board::Divide(uint8_t depth) {
+	std::vector<std::pair<Move, uint64_t>> output;
+	if (depth == 0) return output;
+	
+	const MoveList * moves = GetLegalMoves();
+	const Move * move_i = moves->Begin();
+	const Move * move_end = moves->End();
+	for (; move_i != move_end; move_i++) {
+		Make(*move_i);
+		output.push_back(std::pair<Move, uint64_t>(*move_i, Perft(depth - 1)));
+		Unmake(1);
+	}
+	return output;
+}
+
+uint64_t Board::ParallelPerft(uint8_t depth, unsigned n_threads) {
+	if (n_threads == 0) n_threads = std::thread::hardware_concurrency();
+	if (n_threads <= 1 || depth < 3) return Perft(depth);
+	
+	// Split the tree two ply down; the root alone has too few moves to keep
+	// many threads busy
+	std::vector<std::pair<Move, Move>> tasks;
+	const MoveList * moves = GetLegalMoves();
+	const Move * move_i = moves->Begin();
+	const Move * move_end = moves->End();
+	for (; move_i != move_end; move_i++) {
+		Make(*move_i);
+		const MoveList * replies = GetLegalMoves();
+		const Move * reply_i = replies->Begin();
+		const Move * reply_end = replies->End();
+		for (; reply_i != reply_end; reply_i++) {
+			tasks.push_back(std::pair<Move, Move>(*move_i, *reply_i));
+		}
+		Unmake(1);
+	}
+	
+	// Each thread searches on a board of its own, set to the root position
+	BoardState root = GetCurrent();
+	std::vector<Board *> boards(n_threads);
+	std::vector<uint64_t> counts(n_threads, 0);
+	for (unsigned i = 0; i < n_threads; i++) {
+		boards[i] = new Board();
+		boards[i]->SetCurrent(root);
+	}
+	
+	// Each thread takes the next unclaimed subtree until none are left
+	std::atomic<size_t> next_task(0);
+	std::vector<std::thread> threads;
+	for (unsigned i = 0; i < n_threads; i++) {
+		threads.push_back(std::thread([&, i]() {
+			Board * board = boards[i];
+			uint64_t count = 0;
+			size_t task;
+			while ((task = next_task++) < tasks.size()) {
+				board->Make(tasks[task].first);
+				board->Make(tasks[task].second);
+				count += board->Perft(depth - 2);
+				board->Unmake(2);
+			}
+			counts[i] = count;
+		}));
+	}
+	
+	uint64_t n_nodes = 0;
+	for (unsigned i = 0; i < n_threads; i++) {
+		threads[i].join();
+		n_nodes += counts[i];
+		delete boards[i];
+	}
+	return n_nodes;
+}
+
+uint64_t Board::HashPerft(uint8_t depth, PerftTable * table) {
+	if (depth == 0) return 1;
+	if (depth == 1) return CountLegalMoves();
+	
+	// Subtrees reached by transposition have already been counted
+	uint64_t n_nodes = 0;
+	if (table->Probe(current->hash, depth, &n_nodes)) return n_nodes;
+	
+	const MoveList * moves = GetLegalMoves();
+	const Move * move_i = moves->Begin();
+	const Move * move_end = moves->End();
+	for (; move_i != move_end; move_i++) {
+		Make(*move_i);
+		n_nodes += HashPerft(depth - 1, table);
+		Unmake(1);
+	}
+	
+	table->Store(current->hash, depth, n_nodes);
+	return n_nodes;
+}
+
+PerftTable::PerftTable(size_t size_mb) {
+	// Use the largest power of two number of buckets that fits
+	size_t n_buckets = 1;
+	while (n_buckets * 2 * sizeof(Bucket) <= size_mb * 1024 * 1024) {
+		n_buckets *= 2;
+	}
+	buckets = new Bucket[n_buckets];
+	mask = n_buckets - 1;
+	Clear();
+}
+
+PerftTable::~PerftTable() {
+	delete[] buckets;
+}
+
+bool PerftTable::Probe(Hash_t hash, uint8_t depth, uint64_t * count) {
+	n_probes++;
+	Bucket & bucket = buckets[hash & mask];
+	if (bucket.deep.hash == hash && bucket.deep.depth == depth) {
+		*count = bucket.deep.count;
+	}
+	else if (bucket.recent.hash == hash && bucket.recent.depth == depth) {
+		*count = bucket.recent.count;
+	}
+	else return false;
+	n_hits++;
+	return true;
+}
+
+void PerftTable::Store(Hash_t hash, uint8_t depth, uint64_t count) {
+	Bucket & bucket = buckets[hash & mask];
+	Entry & entry = depth >= bucket.deep.depth ? bucket.deep : bucket.recent;
+	entry.hash = hash;
+	entry.count = count;
+	entry.depth = depth;
+}
+
+void PerftTable::Clear() {
+	// Depth 0 is never stored, so zeroed entries never match
+	memset(buckets, 0, (mask + 1) * sizeof(Bucket));
+	n_probes = 0;
+	n_hits = 0;
+}
\ No newline at end of file
@@ -0,0 +1,64 @@
+#ifndef _ARDALAN_PERFT_H_
+#define _ARDALAN_PERFT_H_
+
+#include "datatypes.h"
+
+#include <stddef.h>
+
+/**
+ * @class PerftTable
+ * @file perft.h
+ * @brief Fixed-size cache of perft subtree counts keyed by position hash and depth.
+ * 
+ * Each bucket holds two entries. The first is only replaced by a subtree at
+ * least as deep, since deeper subtrees cost more to recount; the second is
+ * always replaced, so recently searched subtrees are still found when the
+ * first entry is taken. Probes and hits are counted to report the hit rate.
+ * 
+ * The table is not safe to share between threads.
+ */
+class PerftTable {
+public:
+	/**
+	 * @brief Allocate a table.
+	 * @param size_mb Size of the table in megabytes; rounded down to a power of two.
+	 */
+	PerftTable(size_t size_mb);
+	PerftTable(const PerftTable & other) = delete;
+	PerftTable & operator = (const PerftTable & other) = delete;
+	~PerftTable();
+	
+	bool Probe(Hash_t hash, uint8_t depth, uint64_t * count);
+	void Store(Hash_t hash, uint8_t depth, uint64_t count);
+	void Clear();
+	
+	inline uint64_t GetProbes() const {
+		return n_probes;
+	}
+	inline uint64_t GetHits() const {
+		return n_hits;
+	}
+	inline double GetHitRate() const {
+		return n_probes ? (double)n_hits / n_probes : 0;
+	}
+	inline size_t GetSize() const {
+		return (mask + 1) * sizeof(Bucket);
+	}
+	
+protected:
+	struct Entry {
+		Hash_t hash;
+		uint64_t count : 56, depth : 8;
+	};
+	
+	struct Bucket {
+		Entry deep;
+		Entry recent;
+	};
+	
+	Bucket * buckets = NULL;
+	size_t mask = 0;
+	uint64_t n_probes = 0, n_hits = 0;
+};
+
+#endif
\ No newline at end of file
@@ -71,7 +71,7 @@ bool Board::MakePGNMoves(const char * pgn) {
 			// Get moves to find which one matches the constraints
 			bool any_moves = false;
 			BoardState state = GetCurrent();
-			const MoveList * moves = GetMoves();
+			const MoveList * moves = GetLegalMoves();
 			const Move * move_i = moves->Begin();
 			const Move * move_end = moves->End();
 			for (; move_i != move_end; move_i++) {
@@ -95,14 +95,8 @@ bool Board::MakePGNMoves(const char * pgn) {
 				
 				// Passed all the tests, make the move
 				if (Make(*move_i)) {
-					// Make sure move is legal
-					if (InCheck(state.white_to_move)) {
-						Unmake(1);
-					}
-					else {
-						any_moves = true;
-						break;
-					}
+					any_moves = true;
+					break;
 				}
 				else return false;
 			}
@@ -0,0 +1,142 @@
+#include "stagedgen.h"
+
+// Rough piece values for ordering captures, indexed by piece type without color
+static const int16_t PIECE_VALUES[8] = { 0, 1, 3, 3, 5, 9, 20, 0 };
+
+StagedMoveGenerator::StagedMoveGenerator(MoveGenerator * mgen, const BoardComposite * board,
+		Move hash_move, Move killer_1, Move killer_2) {
+	this->mgen = mgen;
+	this->board = board;
+	this->hash_move = hash_move;
+	this->killers[0] = killer_1;
+	this->killers[1] = killer_2;
+}
+
+bool StagedMoveGenerator::Next(Move * move) {
+	while (stage != STAGE_DONE) {
+		if (stage == STAGE_HASH_MOVE) {
+			if (!generated) {
+				generated = true;
+				if (mgen->IsLegal(board, hash_move)) {
+					*move = hash_move;
+					return true;
+				}
+			}
+		}
+		else if (stage == STAGE_WINNING_CAPTURES) {
+			if (!generated) {
+				generated = true;
+				GenerateCaptures();
+				index = 0;
+			}
+			while (index < n_winning) {
+				Move next = captures[index++];
+				if (SameMove(next, hash_move)) continue;
+				*move = next;
+				return true;
+			}
+		}
+		else if (stage == STAGE_KILLERS) {
+			// Killers were quiet moves elsewhere in the tree, so only accept
+			// them if they are legal and quiet here
+			while (index < 2) {
+				Move next = killers[index++];
+				if (SameMove(next, hash_move)) continue;
+				if (index == 2 && SameMove(next, killers[0])) continue;
+				if (!IsQuiet(next) || !mgen->IsLegal(board, next)) continue;
+				*move = next;
+				return true;
+			}
+		}
+		else if (stage == STAGE_QUIETS) {
+			if (!generated) {
+				generated = true;
+				mgen->GetLegalMoves(board, &quiets, MoveGenerator::QUIETS);
+			}
+			while (index < quiets.Length()) {
+				Move next = quiets.Begin()[index++];
+				if (SameMove(next, hash_move) || SameMove(next, killers[0]) || SameMove(next, killers[1])) continue;
+				*move = next;
+				return true;
+			}
+		}
+		else if (stage == STAGE_LOSING_CAPTURES) {
+			while (index < n_captures) {
+				Move next = captures[index++];
+				if (SameMove(next, hash_move)) continue;
+				*move = next;
+				return true;
+			}
+		}
+		NextStage();
+	}
+	return false;
+}
+
+void StagedMoveGenerator::NextStage() {
+	stage++;
+	generated = false;
+	
+	// Losing captures continue from the end of the winning captures
+	index = stage == STAGE_LOSING_CAPTURES ? n_winning : 0;
+}
+
+void StagedMoveGenerator::GenerateCaptures() {
+	mgen->GetLegalMoves(board, &scratch, MoveGenerator::CAPTURES | MoveGenerator::UNDERPROMOTIONS);
+	
+	int16_t winning_scores[256], losing_scores[256];
+	Move losing_moves[256];
+	uint16_t n_losing = 0;
+	n_winning = 0;
+	
+	const Move * move_i = scratch.Begin();
+	const Move * move_end = scratch.End();
+	for (; move_i != move_end; move_i++) {
+		uint8_t attacker = board->state.squares[move_i->start] & 7;
+		uint8_t victim = move_i->code == Move::EN_PASSANT ? WHITE_PAWN : board->state.squares[move_i->end] & 7;
+		uint8_t promotion = move_i->code == Move::EN_PASSANT ? EMPTY : move_i->code & 7;
+		
+		// Most valuable victim first, then least valuable attacker
+		int16_t score = PIECE_VALUES[victim] * 32 - PIECE_VALUES[attacker];
+		if (promotion) {
+			score += (PIECE_VALUES[promotion] - PIECE_VALUES[WHITE_PAWN]) * 32;
+		}
+		
+		// Underpromotions are always tried late; otherwise a capture is losing
+		// if the exchange on the target square loses material
+		bool losing = (promotion && promotion != WHITE_QUEEN) || mgen->SEE(board, *move_i) < 0;
+		
+		if (losing) InsertSorted(losing_moves, losing_scores, n_losing, *move_i, score);
+		else InsertSorted(captures, winning_scores, n_winning, *move_i, score);
+	}
+	
+	// Losing captures go after the winning captures
+	for (uint16_t i = 0; i < n_losing; i++) {
+		captures[n_winning + i] = losing_moves[i];
+	}
+	n_captures = n_winning + n_losing;
+}
+
+void StagedMoveGenerator::InsertSorted(Move * moves, int16_t * scores, uint16_t & n_moves, Move move, int16_t score) {
+	uint16_t i = n_moves++;
+	for (; i > 0 && scores[i - 1] < score; i--) {
+		moves[i] = moves[i - 1];
+		scores[i] = scores[i - 1];
+	}
+	moves[i] = move;
+	scores[i] = score;
+}
+
+bool StagedMoveGenerator::IsQuiet(Move move) {
+	// Castling is quiet; normal moves are quiet if they do not capture
+	if (move.code >= Move::WHITE_OO && move.code <= Move::BLACK_OOO) return true;
+	return move.code == Move::NORMAL_MOVE && board->state.squares[move.end] == EMPTY;
+}
+
+bool StagedMoveGenerator::SameMove(Move a, Move b) {
+	// Castling and null moves do not use the start and end squares
+	if (a.code == Move::NULL_MOVE || (a.code >= Move::WHITE_OO && a.code <= Move::BLACK_OOO)) {
+		return a.code == b.code;
+	}
+	return a == b;
+}
\ No newline at end of file
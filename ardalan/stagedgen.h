@@ -0,0 +1,76 @@
+#ifndef _ARDALAN_STAGEDGEN_H_
+#define _ARDALAN_STAGEDGEN_H_
+
+#include "datatypes.h"
+#include "movegen.h"
+
+/**
+ * @class StagedMoveGenerator
+ * @file stagedgen.h
+ * @brief Yields the legal moves of a position in the order a search wants them.
+ * 
+ * Moves come out in stages: the hash move, captures and queen promotions that
+ * do not lose material by static exchange evaluation (most valuable victim
+ * first), killer moves, quiet moves, and finally losing captures and
+ * underpromotions. A stage is only generated once the previous one has been
+ * consumed, so a cutoff early in the list skips the remaining generation work.
+ * Hash and killer moves are checked for legality without generating moves
+ * before they are returned, and are never returned twice.
+ * 
+ * The generator keeps a pointer to the Board Composite, which must not change
+ * while moves are being taken from it.
+ */
+class StagedMoveGenerator {
+public:
+	static const uint8_t STAGE_HASH_MOVE = 0;
+	static const uint8_t STAGE_WINNING_CAPTURES = 1;
+	static const uint8_t STAGE_KILLERS = 2;
+	static const uint8_t STAGE_QUIETS = 3;
+	static const uint8_t STAGE_LOSING_CAPTURES = 4;
+	static const uint8_t STAGE_DONE = 5;
+	
+	StagedMoveGenerator(MoveGenerator * mgen, const BoardComposite * board,
+			Move hash_move = Move(), Move killer_1 = Move(), Move killer_2 = Move());
+	
+	/**
+	 * @brief Get the next move, generating the next stage if necessary.
+	 * @param move Output for the move.
+	 * @return Returns false once every legal move has been returned.
+	 */
+	bool Next(Move * move);
+	
+	/**
+	 * @brief Get the stage of the most recently returned move.
+	 */
+	inline uint8_t GetStage() const {
+		return stage;
+	}
+	
+protected:
+	MoveGenerator * mgen;
+	const BoardComposite * board;
+	
+	Move hash_move;
+	Move killers[2];
+	
+	uint8_t stage = STAGE_HASH_MOVE;
+	bool generated = false;
+	uint16_t index = 0;
+	
+	// Captures are scored once; winning captures are at the front and losing
+	// captures at the back, each sorted best first
+	Move captures[256];
+	uint16_t n_winning = 0, n_captures = 0;
+	
+	MoveList quiets;
+	MoveList scratch;
+	
+	void NextStage();
+	void GenerateCaptures();
+	bool IsQuiet(Move move);
+	
+	static void InsertSorted(Move * moves, int16_t * scores, uint16_t & n_moves, Move move, int16_t score);
+	static bool SameMove(Move a, Move b);
+};
+
+#endif
\ No newline at end of file
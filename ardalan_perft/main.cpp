@@ -0,0 +1,164 @@
+#include <board.h>
+
+#include <chrono>
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+struct PerftPosition {
+	const char * name;
+	const char * fen;
+	
+	// Expected leaf counts at depths 1 through 6
+	uint64_t counts[6];
+};
+
+const int N_PERFT_POSITIONS = 6;
+PerftPosition PERFT_POSITIONS[N_PERFT_POSITIONS] = {
+	{
+		"Start",
+		"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+		{20, 400, 8902, 197281, 4865609, 119060324}
+	},
+	{
+		"Kiwipete",
+		"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+		{48, 2039, 97862, 4085603, 193690690, 8031647685}
+	},
+	{
+		"Position 3",
+		"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+		{14, 191, 2812, 43238, 674624, 11030083}
+	},
+	{
+		"Position 4",
+		"r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+		{6, 264, 9467, 422333, 15833292, 706045033}
+	},
+	{
+		"Position 5",
+		"rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+		{44, 1486, 62379, 2103487, 89941194, 3048196529}
+	},
+	{
+		"Position 6",
+		"r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+		{46, 2079, 89890, 3894594, 164075551, 6923051137}
+	}
+};
+
+double Seconds(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void PrintRate(uint64_t n_nodes, double seconds) {
+	std::cout << n_nodes << " nodes in " << seconds << " s";
+	if (seconds > 0) std::cout << " (" << (uint64_t)(n_nodes / seconds) << " nodes/s)";
+	std::cout << std::endl;
+}
+
+int RunSuite(int max_depth, unsigned n_threads, size_t hash_mb) {
+	// Constructing a board chooses the slider and move emission backends
+	Board board;
+	const char * emit_names[3] = { "scalar", "SSE4", "AVX2" };
+	std::cout << "Slider attacks: " << (MoveGenerator::UsingPEXT() ? "PEXT" : "magic");
+	std::cout << ", move emission: " << emit_names[MoveGenerator::GetEmitBackend()] << std::endl;
+	PerftTable * table = hash_mb ? new PerftTable(hash_mb) : NULL;
+	if (table) {
+		std::cout << "Hash table: " << table->GetSize() / (1024 * 1024) << " MB, single thread" << std::endl;
+	}
+	int n_failed = 0;
+	uint64_t total_nodes = 0;
+	double total_seconds = 0;
+	for (int i = 0; i < N_PERFT_POSITIONS; i++) {
+		BoardState state;
+		state.InitFromFEN(PERFT_POSITIONS[i].fen);
+		board.SetCurrent(state);
+		
+		std::cout << PERFT_POSITIONS[i].name << ": " << PERFT_POSITIONS[i].fen << std::endl;
+		for (int depth = 1; depth <= max_depth && depth <= 6; depth++) {
+			uint64_t expected = PERFT_POSITIONS[i].counts[depth - 1];
+			
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			uint64_t n_nodes;
+			if (table) {
+				// Counts from earlier depths are valid, but a fresh table shows
+				// the hit rate of this search alone
+				table->Clear();
+				n_nodes = board.HashPerft(depth, table);
+			}
+			else if (n_threads == 1) n_nodes = board.Perft(depth);
+			else n_nodes = board.ParallelPerft(depth, n_threads);
+			double seconds = Seconds(start);
+			total_nodes += n_nodes;
+			total_seconds += seconds;
+			
+			std::cout << "  depth " << depth << ": " << (n_nodes == expected ? "OK   " : "FAIL ");
+			PrintRate(n_nodes, seconds);
+			if (table) {
+				std::cout << "    hash hits " << table->GetHits() << " / " << table->GetProbes();
+				std::cout << " (" << 100 * table->GetHitRate() << "%)" << std::endl;
+			}
+			if (n_nodes != expected) {
+				std::cout << "    expected " << expected << std::endl;
+				n_failed++;
+			}
+		}
+	}
+	std::cout << "Total: ";
+	PrintRate(total_nodes, total_seconds);
+	std::cout << n_failed << " failed" << std::endl;
+	delete table;
+	return n_failed;
+}
+
+int RunDivide(int depth, const char * fen) {
+	Board board;
+	BoardState state;
+	if (!state.InitFromFEN(fen)) {
+		std::cout << "Invalid FEN: " << fen << std::endl;
+		return 1;
+	}
+	board.SetCurrent(state);
+	
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::vector<std::pair<Move, uint64_t>> counts = board.Divide(depth);
+	double seconds = Seconds(start);
+	
+	uint64_t n_nodes = 0;
+	for (size_t i = 0; i < counts.size(); i++) {
+		std::cout << counts[i].first << ": " << counts[i].second << std::endl;
+		n_nodes += counts[i].second;
+	}
+	std::cout << counts.size() << " moves, ";
+	PrintRate(n_nodes, seconds);
+	return 0;
+}
+
+int main(int argc, char ** argv) {
+	// ardalan_perft [max_depth [threads [hash_mb]]]
+	//		Run the standard suite up to a depth (default 5) with a number of
+	//		threads (default 1, 0 for one per core), or with a hash table of
+	//		subtree counts on a single thread if a size is given
+	// ardalan_perft divide <depth> <fen>
+	//		Count the leaf nodes under each root move of a position
+	if (argc >= 4 && !strcmp(argv[1], "divide")) {
+		// Rejoin the FEN if it was passed as separate arguments
+		std::string fen = argv[3];
+		for (int i = 4; i < argc; i++) {
+			fen += std::string(" ") + argv[i];
+		}
+		return RunDivide(atoi(argv[2]), fen.c_str());
+	}
+	else if (argc <= 4 && (argc == 1 || atoi(argv[1]) > 0)) {
+		int max_depth = argc >= 2 ? atoi(argv[1]) : 5;
+		unsigned n_threads = argc >= 3 ? atoi(argv[2]) : 1;
+		size_t hash_mb = argc >= 4 ? atoi(argv[3]) : 0;
+		return RunSuite(max_depth, n_threads, hash_mb) ? 1 : 0;
+	}
+	
+	std::cout << "Usage: " << argv[0] << " [max_depth [threads [hash_mb]]]" << std::endl;
+	std::cout << "       " << argv[0] << " divide <depth> <fen>" << std::endl;
+	return 1;
+}
\ No newline at end of file
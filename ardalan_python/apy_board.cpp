@@ -221,13 +221,18 @@ PyObject * APy_Board_Unmake(PyObject * self_arg, PyObject * args, PyObject * kwd
 
 static const char * BOARD_GETMOVES_DOCSTR =
 "Get the moves available in the current position.\n"
-"Illegal moves (like moving into check) are not filtered out.\n";
+"Illegal moves (like moving into check) are not filtered out.\n"
+"Raises OverflowError if there are more moves than a move list can hold.\n";
 PyObject * APy_Board_GetMoves(PyObject * self_arg, PyObject * args, PyObject * kwds) {
 	APy_Board * self = (APy_Board *)self_arg;
 	const MoveList * moves = self->m_board->GetMoves();
 	if (!moves->IsValid()) {
 		Py_RETURN_NONE;
 	}
+	if (moves->IsTruncated()) {
+		PyErr_SetString(PyExc_OverflowError, "Position has more moves than a move list can hold");
+		return NULL;
+	}
 	
 	int n_moves = moves->Length();
 	const Move * move_i = moves->Begin();
@@ -242,40 +247,38 @@ PyObject * APy_Board_GetMoves(PyObject * self_arg, PyObject * args, PyObject * k
 }
 
 static const char * BOARD_GETLEGALMOVES_DOCSTR =
-"Get the legal moves available in the current position.\n";
+"Get the legal moves available in the current position.\n"
+"Raises OverflowError if there are more moves than a move list can hold.\n";
 PyObject * APy_Board_GetLegalMoves(PyObject * self_arg, PyObject * args, PyObject * kwds) {
 	APy_Board * self = (APy_Board *)self_arg;
-	const MoveList * moves = self->m_board->GetMoves();
+	const MoveList * moves = self->m_board->GetLegalMoves();
 	if (!moves->IsValid()) {
 		Py_RETURN_NONE;
 	}
+	if (moves->IsTruncated()) {
+		PyErr_SetString(PyExc_OverflowError, "Position has more moves than a move list can hold");
+		return NULL;
+	}
 	
 	int n_moves = moves->Length();
-	Move * legal = new Move[n_moves];
-	int n_legal = 0;
-	
-	bool white_to_move = self->m_board->GetCurrent().white_to_move;
-	
 	const Move * move_i = moves->Begin();
+	PyObject * output = PyList_New(n_moves);
 	for (int i = 0; i < n_moves; i++, move_i++) {
-		if (self->m_board->Make(*move_i)) {
-			if (!self->m_board->InCheck(white_to_move)) {
-				legal[n_legal++] = *move_i;
-			}
-			self->m_board->Unmake(1);
-		}
-	}
-	
-	PyObject * output = PyList_New(n_legal);
-	for (int i = 0; i < n_legal; i++) {
-		APy_Move * move = (APy_Move *)APy_Move_new(&APy_MoveType, NULL, NULL);
-		move->m_move = legal[i];
-		PyList_SetItem(output, i, (PyObject *)move);
+		APy_Move * new_move = (APy_Move *)APy_Move_new(&APy_MoveType, NULL, NULL);
+		new_move->m_move = *move_i;
+		PyList_SetItem(output, i, (PyObject *)new_move);
 	}
 	
 	return output;
 }
 
+static const char * BOARD_COUNTLEGALMOVES_DOCSTR =
+"Count the legal moves available in the current position without listing them.\n";
+PyObject * APy_Board_CountLegalMoves(PyObject * self_arg, PyObject * args, PyObject * kwds) {
+	APy_Board * self = (APy_Board *)self_arg;
+	return PyLong_FromLong(self->m_board->CountLegalMoves());
+}
+
 static const char * BOARD_INCHECK_DOCSTR =
 "Determine whether the specified color is in check.\n";
 PyObject * APy_Board_InCheck(PyObject * self_arg, PyObject * args, PyObject * kwds) {
@@ -331,6 +334,7 @@ PyMethodDef APy_Board_methods[] = {
 	{"Unmake",			(PyCFunction)APy_Board_Unmake,				METH_VARARGS,	(char *)BOARD_UNMAKE_DOCSTR},
 	{"GetMoves",		(PyCFunction)APy_Board_GetMoves,			METH_NOARGS,	(char *)BOARD_GETMOVES_DOCSTR},
 	{"GetLegalMoves",	(PyCFunction)APy_Board_GetLegalMoves,		METH_NOARGS,	(char *)BOARD_GETLEGALMOVES_DOCSTR},
+	{"CountLegalMoves",	(PyCFunction)APy_Board_CountLegalMoves,		METH_NOARGS,	(char *)BOARD_COUNTLEGALMOVES_DOCSTR},
 	{"InCheck",			(PyCFunction)APy_Board_InCheck,				METH_VARARGS,	(char *)BOARD_INCHECK_DOCSTR},
 	{"IsCheckmate",		(PyCFunction)APy_Board_IsCheckmate,			METH_NOARGS,	(char *)BOARD_ISCHECKMATE_DOCSTR},
 	{"IsStalemate",		(PyCFunction)APy_Board_IsStalemate,			METH_NOARGS,	(char *)BOARD_ISSTALEMATE_DOCSTR},
@@ -54,6 +54,7 @@ PyObject*	APy_Board_Make			(PyObject * self_arg, PyObject * args, PyObject * kwd
 PyObject*	APy_Board_Unmake		(PyObject * self_arg, PyObject * args, PyObject * kwds);
 PyObject*	APy_Board_GetMoves		(PyObject * self_arg, PyObject * args, PyObject * kwds);
 PyObject*	APy_Board_GetLegalMoves	(PyObject * self_arg, PyObject * args, PyObject * kwds);
+PyObject*	APy_Board_CountLegalMoves	(PyObject * self_arg, PyObject * args, PyObject * kwds);
 PyObject*	APy_Board_InCheck		(PyObject * self_arg, PyObject * args, PyObject * kwds);
 PyObject*	APy_Board_IsCheckmate	(PyObject * self_arg, PyObject * args, PyObject * kwds);
 PyObject*	APy_Board_IsStalemate	(PyObject * self_arg, PyObject * args, PyObject * kwds);
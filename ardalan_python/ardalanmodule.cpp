@@ -1,14 +1,78 @@
 #include "apy_types.h"
 
+#include <movegen.h>
+
 #include <Python.h>
 
 #include <iostream>
+#include <vector>
 
 #ifndef PyMODINIT_FUNC
 #define PyMODINIT_FUNC void
 #endif
 
+static const char * ARDALAN_GETLEGALMOVESBATCH_DOCSTR =
+"Get the legal moves of each state in a sequence, as a list of lists of moves.\n"
+"Moves are generated with the optional number of threads (0 for one per core).\n"
+"Raises OverflowError if a state has more moves than a move list can hold.\n";
+static PyObject * APy_GetLegalMovesBatch(PyObject * self, PyObject * args, PyObject * kwds) {
+	PyObject * arg_states = NULL;
+	unsigned int arg_threads = 1;
+	static char * keywords[] = {
+		"states",
+		"threads",
+		NULL
+	};
+	
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|I", keywords, &arg_states, &arg_threads)) {
+		return NULL;
+	}
+	
+	PyObject * sequence = PySequence_Fast(arg_states, "Must pass a sequence of ardalan.State");
+	if (!sequence) return NULL;
+	
+	// Copy the states out so that the moves can be generated without the GIL
+	Py_ssize_t n_states = PySequence_Fast_GET_SIZE(sequence);
+	std::vector<BoardState> states(n_states);
+	for (Py_ssize_t i = 0; i < n_states; i++) {
+		PyObject * state = PySequence_Fast_GET_ITEM(sequence, i);
+		if (!PyObject_TypeCheck(state, &APy_StateType)) {
+			PyErr_SetString(PyExc_TypeError, "Must pass a sequence of ardalan.State");
+			Py_DECREF(sequence);
+			return NULL;
+		}
+		states[i] = ((APy_State *)state)->m_state;
+	}
+	Py_DECREF(sequence);
+	
+	static MoveGenerator mgen;
+	MoveBatch batch;
+	Py_BEGIN_ALLOW_THREADS
+	mgen.GetLegalMoves(states.data(), states.size(), &batch, arg_threads);
+	Py_END_ALLOW_THREADS
+	if (batch.truncated) {
+		PyErr_SetString(PyExc_OverflowError, "A state has more moves than a move list can hold");
+		return NULL;
+	}
+	
+	PyObject * output = PyList_New(n_states);
+	for (Py_ssize_t i = 0; i < n_states; i++) {
+		int n_moves = batch.Length(i);
+		const Move * move_i = batch.Begin(i);
+		PyObject * moves = PyList_New(n_moves);
+		for (int j = 0; j < n_moves; j++, move_i++) {
+			APy_Move * new_move = (APy_Move *)APy_Move_new(&APy_MoveType, NULL, NULL);
+			new_move->m_move = *move_i;
+			PyList_SetItem(moves, j, (PyObject *)new_move);
+		}
+		PyList_SetItem(output, i, moves);
+	}
+	
+	return output;
+}
+
 static PyMethodDef ardalan_methods[] = {
+	{"GetLegalMovesBatch",	(PyCFunction)APy_GetLegalMovesBatch,	METH_VARARGS | METH_KEYWORDS,	(char *)ARDALAN_GETLEGALMOVESBATCH_DOCSTR},
 	{NULL, NULL, 0, NULL}
 };
 
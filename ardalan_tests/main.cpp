@@ -6,7 +6,21 @@ int main(int argc, char ** argv) {
 	//Test_MoveGeneration();
 	//Test_CheckDetection();
 	//Test_UnmoveGeneration();
+	//Test_RetroUnmoves();
 	//Test_PGN();
 	Test_Hashing();
+	//Test_SliderBackends();
+	//Test_EmitBackends();
+	//Test_LegalMoves();
+	//Test_MoveBatch();
+	//Test_StagedMoves();
+	//Test_QuiescenceGenerators();
+	//Test_SEE();
+	//Test_MoveLegality();
+	//Test_PlyStack();
+	//Test_MakeInPlace();
+	//Test_PackedState();
+	//Test_Repetition();
+	//Test_GameStatus();
 	return 0;
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include <board.h>
 
+#include <chrono>
 #include <iostream>
 
 struct TestPositionA {
@@ -164,7 +165,70 @@ void Test_UnmoveGeneration() {
 		board.SetCurrent(state);
 		
 		const MoveList * unmoves = board.GetUnmoves();
-		std::cout << board << std::endl;
+		std::cout << board;
+		std::cout << "Unmoves: " << *unmoves << std::endl << std::endl;
+	}
+}
+
+void Test_RetroUnmoves() {
+	const char * FENS[] = {
+		// White just promoted on b8 or c8, or moved the king; the knight
+		// cannot have come from a6 or c6 while checking the king on b4
+		"1N6/8/8/8/1k6/8/8/K7 b - - 0 1",
+		// Black just played d7-d5, so nothing else can be undone
+		"4k3/8/8/3pP3/8/8/8/4K3 w - d6 0 2",
+		// White may have captured en passant on e6
+		"4k3/8/4P3/8/8/8/8/4K3 b - - 0 1",
+		// After 1. e4 e5, the position before e7-e5 had an en passant target
+		"rnbqkbnr/pppp1ppp/8/4p3/4P3/8/PPPP1PPP/RNBQKBNR w KQkq e6 0 2",
+		// White may have just castled, or moved the king or a rook from home
+		// and lost castling rights
+		"4k3/8/8/8/8/8/8/R4RK1 b - - 1 1",
+		"4k3/8/8/8/8/8/4K3/R6R b - - 1 1"
+	};
+	
+	// Allow one more of each piece to have been captured
+	Material_t max_material = 0;
+	for (uint8_t piece = WHITE_PAWN; piece <= BLACK_QUEEN; piece++) {
+		max_material += MaterialOf(piece);
+	}
+	
+	MoveGenerator mgen;
+	for (const char * fen : FENS) {
+		BoardState state;
+		state.InitFromFEN(fen);
+		BoardComposite board;
+		board.Init(state);
+		
+		std::vector<Unmove> unmoves;
+		mgen.GetUnmoves(&board, &unmoves, max_material);
+		
+		// Each earlier position should lead back here through the move
+		int n_failed = 0;
+		for (const Unmove & unmove : unmoves) {
+			BoardState earlier;
+			MoveGenerator::MakeUnmove(state, unmove, &earlier);
+			Board replay;
+			replay.SetCurrent(earlier);
+			if (!replay.Make(unmove.move) || !(replay.GetCurrent() == state)) n_failed++;
+		}
+		
+		// Legal unmoves do not leave the king of the color to move in check
+		std::vector<Unmove> legal_unmoves;
+		std::vector<BoardState> earlier_states;
+		mgen.GetLegalUnmoves(&board, &legal_unmoves, &earlier_states, max_material);
+		for (const BoardState & earlier : earlier_states) {
+			BoardComposite earlier_board;
+			earlier_board.Init(earlier);
+			if (mgen.InCheck(&earlier_board, state.white_to_move)) n_failed++;
+		}
+		
+		std::cout << fen << std::endl << unmoves.size() << " unmoves, " << legal_unmoves.size() << " legal, ";
+		std::cout << n_failed << " failed:";
+		for (const Unmove & unmove : legal_unmoves) {
+			std::cout << " " << unmove;
+		}
+		std::cout << std::endl;
 	}
 }
 
@@ -207,4 +271,384 @@ void Test_Hashing() {
 	board.SetCurrent(BoardState());
 	board.MakePGNMoves("e4 e5 Nf3 Nc6 Bb5 a6 O-O Nf6 Ba4");
 	std::cout << board;
-}
\ No newline at end of file
+}
+
+void Test_SliderBackends() {
+	// Constructing a board builds the attack tables
+	Board board;
+	
+	std::cout << "Slider backend: " << (MoveGenerator::UsingPEXT() ? "PEXT" : "Magic") << std::endl;
+	if (MoveGenerator::CheckSliderBackends()) {
+		std::cout << "PEXT and magic attacks match for every square and occupancy" << std::endl;
+	}
+	else {
+		std::cout << "PEXT attacks are unavailable or do not match magic attacks" << std::endl;
+	}
+}
+
+void Test_EmitBackends() {
+	// Constructing a board chooses the emission backend
+	Board board;
+	
+	const char * names[3] = { "Scalar", "SSE4", "AVX2" };
+	uint8_t chosen = MoveGenerator::GetEmitBackend();
+	std::cout << "Emission backend: " << names[chosen] << std::endl;
+	if (MoveGenerator::CheckEmitBackends()) {
+		std::cout << "Emission backend matches scalar emission" << std::endl;
+	}
+	else {
+		std::cout << "Emission backend does not match scalar emission" << std::endl;
+	}
+	
+	// Every supported backend should find the same number of legal moves
+	BoardState state;
+	state.InitFromFEN("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+	board.SetCurrent(state);
+	for (uint8_t backend = MoveGenerator::EMIT_SCALAR; backend <= MoveGenerator::EMIT_AVX2; backend++) {
+		if (!MoveGenerator::SetEmitBackend(backend)) {
+			std::cout << names[backend] << ": unsupported" << std::endl;
+			continue;
+		}
+		std::cout << names[backend] << ": " << board.CountLegalMoves() << " legal moves (48 expected), "
+			<< board.Perft(3) << " nodes at depth 3 (97862 expected)" << std::endl;
+	}
+	MoveGenerator::SetEmitBackend(chosen);
+}
+
+struct TestPositionC {
+	const char * fen;
+	int n_legal;
+};
+
+const int N_TEST_POSITIONS_C = 5;
+TestPositionC TEST_POSITIONS_C[N_TEST_POSITIONS_C] = {
+	// Capturing en passant would expose the king along the rank
+	{"8/8/8/KPp4r/8/8/8/7k w - c6 0 2",			4},
+	// Capturing en passant would expose the king along the diagonal
+	{"8/8/8/8/k2Pp2Q/8/8/3K4 b - d3 0 1",			6},
+	// Castling kingside would pass through a square attacked by the rook
+	{"4k3/8/8/8/8/8/5r2/R3K2R w KQ - 0 1",			22},
+	// Double check from the knight and bishop
+	{"4k3/8/8/8/1b6/3n4/8/R3K2R w KQ - 0 1",		3},
+	// The pinned rook may only move along the pin
+	{"4k3/8/8/8/4r3/8/4R3/4K3 w - - 0 1",			6}
+};
+
+void Test_LegalMoves() {
+	Board board;
+	for (int i = 0; i < N_TEST_POSITIONS_C; i++) {
+		BoardState state;
+		state.InitFromFEN(TEST_POSITIONS_C[i].fen);
+		board.SetCurrent(state);
+		
+		// Filter pseudo-legal moves by making them for comparison
+		int n_filtered = 0;
+		MoveList moves = *board.GetMoves();
+		const Move * move_i = moves.Begin();
+		const Move * move_end = moves.End();
+		for (; move_i != move_end; move_i++) {
+			if (board.Make(*move_i)) {
+				if (!board.InCheck(state.white_to_move)) n_filtered++;
+				board.Unmake(1);
+			}
+		}
+		
+		// Count before the list is generated, so the counts are not taken from the cache
+		int n_counted = board.CountLegalMoves();
+		bool has_any = board.HasAnyLegalMove();
+		
+		int n_legal = board.GetLegalMoves()->Length();
+		std::cout << TEST_POSITIONS_C[i].fen << std::endl;
+		if (n_legal == TEST_POSITIONS_C[i].n_legal && n_legal == n_filtered
+				&& n_counted == n_legal && has_any == (n_legal > 0)) {
+			std::cout << "Passed: " << n_legal << " legal moves" << std::endl;
+		}
+		else {
+			std::cout << "Failed: " << n_legal << " legal moves, " << n_filtered << " after filtering, ";
+			std::cout << n_counted << " counted, " << TEST_POSITIONS_C[i].n_legal << " expected" << std::endl;
+		}
+	}
+}
+
+void Test_MoveBatch() {
+	MoveGenerator mgen;
+	
+	// Repeat the positions so that the batch is split between threads
+	const int N_REPEATS = 64;
+	std::vector<BoardState> states;
+	for (int repeat = 0; repeat < N_REPEATS; repeat++) {
+		for (int i = 0; i < N_TEST_POSITIONS_C; i++) {
+			BoardState state;
+			state.InitFromFEN(TEST_POSITIONS_C[i].fen);
+			states.push_back(state);
+		}
+	}
+	
+	for (unsigned n_threads = 1; n_threads <= 4; n_threads *= 2) {
+		MoveBatch batch;
+		mgen.GetLegalMoves(states.data(), states.size(), &batch, n_threads);
+		
+		int n_failed = 0;
+		for (size_t i = 0; i < states.size(); i++) {
+			if (batch.Length(i) != TEST_POSITIONS_C[i % N_TEST_POSITIONS_C].n_legal) n_failed++;
+		}
+		std::cout << n_threads << " threads: " << batch.Size() << " positions, " << batch.moves.size() << " moves, ";
+		std::cout << n_failed << " with the wrong number of moves" << std::endl;
+	}
+}
+
+void Test_StagedMoves() {
+	const char * STAGE_NAMES[] = { "Hash", "Winning captures", "Killers", "Quiets", "Losing captures" };
+	Board board;
+	BoardState state;
+	state.InitFromFEN("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+	board.SetCurrent(state);
+	
+	// Hash move is a capture, killers are one legal and one illegal move
+	StagedMoveGenerator staged = board.GetStagedMoves(Move("e2-a6"), Move("wO-O"), Move("a1-a3"));
+	
+	int n_staged = 0;
+	uint8_t last_stage = StagedMoveGenerator::STAGE_DONE;
+	Move move;
+	while (staged.Next(&move)) {
+		if (staged.GetStage() != last_stage) {
+			last_stage = staged.GetStage();
+			std::cout << std::endl << STAGE_NAMES[last_stage] << ":";
+		}
+		std::cout << " " << move;
+		n_staged++;
+	}
+	std::cout << std::endl;
+	
+	int n_legal = board.GetLegalMoves()->Length();
+	if (n_staged == n_legal) std::cout << "Passed: " << n_staged << " moves" << std::endl;
+	else std::cout << "Failed: " << n_staged << " staged moves, " << n_legal << " legal moves" << std::endl;
+}
+
+void Test_QuiescenceGenerators() {
+	const char * fens[] = {
+		// Captures, en passant after d7-d5, and capturing promotions on a8 and c8
+		"r1n4k/1P6/8/3pP3/8/2n5/8/R3K3 w - d6 0 1",
+		// Checked by the knight; the king can move or the bishop can capture
+		"4k3/8/8/8/8/3n4/8/4KB2 w - - 0 1",
+		// Quiet checks by the rook, by castling, and by the knight uncovering the bishop
+		"8/8/5k2/8/8/8/1N6/B3K2R w K - 0 1"
+	};
+	MoveGenerator mgen;
+	for (int i = 0; i < 3; i++) {
+		BoardState state;
+		state.InitFromFEN(fens[i]);
+		BoardComposite bc;
+		bc.Init(state);
+		
+		MoveList captures, evasions, checks;
+		mgen.GetCaptures(&bc, &captures);
+		mgen.GetEvasions(&bc, &evasions);
+		mgen.GetQuietChecks(&bc, &checks);
+		std::cout << fens[i] << std::endl;
+		std::cout << "Captures: " << captures << std::endl;
+		std::cout << "Evasions: " << evasions << std::endl;
+		std::cout << "Quiet checks: " << checks << std::endl;
+	}
+}
+
+void Test_SEE() {
+	struct {
+		const char * fen;
+		const char * start;
+		const char * end;
+		uint8_t code;
+		Score_t expected;
+	} cases[] = {
+		// Undefended pawn
+		{ "1k1r4/1pp4p/p7/4p3/8/P5P1/1PP4P/2K1R3 w - - 0 1", "e1", "e5", Move::NORMAL_MOVE, 100 },
+		// Knight for pawn once the rook, queen, bishop and queen x-rays are counted
+		{ "1k1r3q/1ppn3p/p4b2/4p3/8/P2N2P1/1PP1R1BP/2K1Q3 w - - 0 1", "d3", "e5", Move::NORMAL_MOVE, -200 },
+		// Queen takes a pawn defended by a pawn
+		{ "4k3/8/2p5/3p4/8/8/8/3QK3 w - - 0 1", "d1", "d5", Move::NORMAL_MOVE, -800 },
+		// En passant
+		{ "4k3/8/8/3pP3/8/8/8/4K3 w - d6 0 1", "e5", "d6", Move::EN_PASSANT, 100 }
+	};
+	MoveGenerator mgen;
+	for (int i = 0; i < 4; i++) {
+		BoardState state;
+		state.InitFromFEN(cases[i].fen);
+		BoardComposite bc;
+		bc.Init(state);
+		
+		Move move(Text2Coord(cases[i].start), Text2Coord(cases[i].end), cases[i].code);
+		Score_t see = mgen.SEE(&bc, move);
+		std::cout << cases[i].fen << std::endl;
+		std::cout << "SEE of " << move << ": " << see << " (expected " << cases[i].expected << ")"
+			<< (see == cases[i].expected ? "" : " FAIL") << std::endl;
+	}
+}
+
+void Test_MoveLegality() {
+	// The knight on f2 is pinned, the rook guards the second rank, and the
+	// pawn on e5 can capture en passant
+	//		pseudo-legal and legal: e5-e6, e1-d1, e5xd6
+	//		pseudo-legal only: f2-g4, f2-d3, e1-e2, e1-d2
+	//		neither: e5-e7, h4-g3
+	Board board;
+	BoardState state;
+	state.InitFromFEN("4k3/8/8/3pP3/7b/8/r4N2/4K3 w - d6 0 1");
+	board.SetCurrent(state);
+	std::cout << board << std::endl;
+	
+	const char * moves[] = { "e5-e6", "e1-d1", "f2-g4", "f2-d3", "e1-e2", "e1-d2", "e5-e7", "h4-g3" };
+	for (int i = 0; i < 8; i++) {
+		Move move(moves[i]);
+		std::cout << move << ": pseudo-legal " << board.IsPseudoLegal(move)
+			<< ", legal " << board.IsLegal(move) << std::endl;
+	}
+	Move en_passant(Text2Coord("e5"), Text2Coord("d6"), Move::EN_PASSANT);
+	std::cout << en_passant << ": pseudo-legal " << board.IsPseudoLegal(en_passant)
+		<< ", legal " << board.IsLegal(en_passant) << std::endl;
+}
+
+void Test_PlyStack() {
+	// Shuffle the knights back and forth far enough to fill several blocks of
+	// the ply stack, then walk back down to the initial position
+	Board board;
+	BoardState state;
+	state.InitFromFEN("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+	board.SetCurrent(state);
+	
+	const char * moves[] = { "g1-f3", "g8-f6", "f3-g1", "f6-g8" };
+	int n_ply = 1000, n_wrong = 0;
+	for (int i = 0; i < n_ply; i++) {
+		if (!board.Make(Move(moves[i % 4]))) n_wrong++;
+		if ((i % 4 == 3) != (board.GetCurrent() == state)) n_wrong++;
+	}
+	std::vector<Move> made = board.GetMadeMoves();
+	for (int i = 0; i < n_ply; i++) {
+		if (!(made[i] == Move(moves[i % 4]))) n_wrong++;
+	}
+	for (int i = n_ply - 1; i >= 0; i--) {
+		board.Unmake(1);
+		if ((i % 4 == 0) != (board.GetCurrent() == state)) n_wrong++;
+	}
+	std::cout << "Made and unmade " << n_ply << " ply: " << n_wrong << " wrong, depth " << board.GetDepth()
+		<< ", unmake past start " << (board.Unmake(1) ? "allowed" : "refused") << std::endl;
+}
+
+void Test_MakeInPlace() {
+	// Perft counts with moves made in place should match those with copies,
+	// and the position should be left as it was
+	const char * fens[] = {
+		"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+		"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+		"r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1"
+	};
+	Board board;
+	for (int i = 0; i < 3; i++) {
+		BoardState state;
+		state.InitFromFEN(fens[i]);
+		board.SetCurrent(state);
+		
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		uint64_t copied = board.Perft(4);
+		std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+		uint64_t in_place = board.PerftInPlace(4);
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+		std::cout << fens[i] << std::endl;
+		std::cout << "Copy-make: " << copied << " (" << std::chrono::duration<double>(middle - start).count() << " seconds)"
+			<< ", in place: " << in_place << " (" << std::chrono::duration<double>(end - middle).count() << " seconds)"
+			<< (copied == in_place && board.GetCurrent() == state ? "" : " FAIL") << std::endl;
+	}
+}
+
+void Test_PackedState() {
+	// Packing and unpacking should give back the same state, with the same
+	// hash, whether packed from a Board State or a Board Composite
+	const char * fens[] = {
+		"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+		"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R b Kq - 7 1",
+		"8/8/8/8/k2Pp2Q/8/8/3K4 b - d3 0 1"
+	};
+	std::cout << "Packed size: " << sizeof(PackedState) << " bytes (Board State: " << sizeof(BoardState) << " bytes)" << std::endl;
+	for (int i = 0; i < 3; i++) {
+		BoardState state;
+		state.InitFromFEN(fens[i]);
+		BoardComposite bc;
+		bc.Init(state);
+		
+		PackedState packed(state);
+		PackedState packed_bc;
+		packed_bc.Init(bc);
+		BoardState unpacked = packed.GetState();
+		std::cout << fens[i] << " -> " << unpacked.GetFEN()
+			<< (unpacked == state && packed == packed_bc && packed.GetHash() == state.GetHash() ? "" : " FAIL") << std::endl;
+	}
+}
+
+void Test_Repetition() {
+	// Shuffle the knights out and back: the initial position repeats every four
+	// ply, until a pawn move makes earlier positions unreachable
+	const char * moves[] = { "g1-f3", "g8-f6", "f3-g1", "f6-g8", "e2-e3", "e7-e6", "g1-f3", "g8-f6", "f3-g1", "f6-g8" };
+	for (int filter = 0; filter < 2; filter++) {
+		Board board;
+		BoardState state;
+		state.InitFromFEN("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+		board.SetCurrent(state);
+		board.SetRepetitionFilter(filter);
+		
+		std::cout << (filter ? "With" : "Without") << " filter:";
+		for (int i = 0; i < 10; i++) {
+			board.Make(Move(moves[i]));
+			std::cout << " " << board.IsDrawByRepetition();
+		}
+		std::cout << " (expected 0 0 0 1 0 0 0 0 0 1)" << std::endl;
+		
+		// Repeat the shuffle, making the last moves in place
+		Board in_place;
+		in_place.SetCurrent(state);
+		in_place.SetRepetitionFilter(filter);
+		std::cout << (filter ? "With" : "Without") << " filter, in place:";
+		for (int i = 0; i < 7; i++) {
+			in_place.Make(Move(moves[i % 4]));
+		}
+		Undo undo[2];
+		in_place.MakeInPlace(Move(moves[3]), &undo[0]);
+		std::cout << " " << in_place.IsDrawByRepetition() << " " << in_place.GetStatus().repetition;
+		in_place.MakeInPlace(Move(moves[0]), &undo[1]);
+		std::cout << " " << in_place.IsDrawByRepetition();
+		in_place.UnmakeInPlace(undo[1]);
+		in_place.UnmakeInPlace(undo[0]);
+		std::cout << " " << in_place.IsDrawByRepetition() << " " << in_place.GetStatus().repetition;
+		std::cout << " (expected 1 1 1 1 1)" << std::endl;
+	}
+}
+
+void Test_GameStatus() {
+	struct {
+		const char * fen;
+		const char * expected;
+	} cases[] = {
+		{ "rnb1kbnr/pppp1ppp/8/4p3/6Pq/5P2/PPPPP2P/RNBQKBNR w KQkq - 1 3", "check, checkmate" },
+		{ "7k/5Q2/6K1/8/8/8/8/8 b - - 0 1", "stalemate, draw" },
+		{ "8/8/4k3/8/8/3KB3/8/8 w - - 0 1", "insufficient material, draw" },
+		{ "8/8/2b1k3/8/8/3K1B2/8/8 w - - 0 1", "insufficient material, draw" },
+		{ "8/8/3bk3/8/8/3K1B2/8/8 w - - 0 1", "" },
+		{ "8/8/4k3/8/8/3K4/8/6NN w - - 0 1", "" },
+		{ "8/8/4k3/8/8/3K4/8/7R w - - 101 80", "no progress, draw" }
+	};
+	Board board;
+	for (int i = 0; i < 7; i++) {
+		BoardState state;
+		state.InitFromFEN(cases[i].fen);
+		board.SetCurrent(state);
+		
+		GameStatus status = board.GetStatus();
+		std::cout << cases[i].fen << ":"
+			<< (status.in_check ? " check," : "")
+			<< (status.IsCheckmate() ? " checkmate," : "")
+			<< (status.IsStalemate() ? " stalemate," : "")
+			<< (status.repetition ? " repetition," : "")
+			<< (status.no_progress ? " no progress," : "")
+			<< (status.insufficient_material ? " insufficient material," : "")
+			<< (status.IsDraw() ? " draw" : "")
+			<< " (expected " << cases[i].expected << ")" << std::endl;
+	}
+}
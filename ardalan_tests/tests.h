@@ -6,7 +6,21 @@ void Test_BoardCompositeInit();
 void Test_MoveGeneration();
 void Test_CheckDetection();
 void Test_UnmoveGeneration();
+void Test_RetroUnmoves();
 void Test_PGN();
 void Test_Hashing();
+void Test_SliderBackends();
+void Test_EmitBackends();
+void Test_LegalMoves();
+void Test_MoveBatch();
+void Test_StagedMoves();
+void Test_QuiescenceGenerators();
+void Test_SEE();
+void Test_MoveLegality();
+void Test_PlyStack();
+void Test_MakeInPlace();
+void Test_PackedState();
+void Test_Repetition();
+void Test_GameStatus();
 
 #endif
\ No newline at end of file
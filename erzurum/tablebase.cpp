@@ -35,7 +35,8 @@ TableBase::~TableBase() {
 bool TableBase::AddStaticallySolved(BoardState state, uint8_t result) {
 	
 	// Check that node does not already exist
-	PosIterator pos_i = positions.find(state);
+	PackedState key(state);
+	PosIterator pos_i = positions.find(key);
 	if (pos_i != positions.end()) {
 		Node * node = pos_i->second;
 		// If already exists, just modify
@@ -56,7 +57,7 @@ bool TableBase::AddStaticallySolved(BoardState state, uint8_t result) {
 		.next = NULL,
 		.move_to_next = Move()
 	};
-	positions.insert(std::pair<BoardState, Node *>(state, new_node));
+	positions.insert(std::pair<PackedState, Node *>(key, new_node));
 	
 	// Add unmoves to frontier
 	AddUnmovesToFrontier(state);
@@ -67,7 +68,8 @@ bool TableBase::AddStaticallySolved(BoardState state, uint8_t result) {
 bool TableBase::AddFrontier(BoardState state) {
 	
 	// Check that node does not already exist
-	if (positions.find(state) != positions.end()) {
+	PackedState key(state);
+	if (positions.find(key) != positions.end()) {
 		return false;
 	}
 	
@@ -79,14 +81,14 @@ bool TableBase::AddFrontier(BoardState state) {
 		.next = NULL,
 		.move_to_next = Move()
 	};
-	positions.insert(std::pair<BoardState, Node *>(state, new_node));
+	positions.insert(std::pair<PackedState, Node *>(key, new_node));
 	return true;
 }
 
-bool TableBase::AddLinkedSolved(BoardState state, uint8_t result, Node * next, BoardState next_state, Move move_to_next) {
+bool TableBase::AddLinkedSolved(BoardState state, uint8_t result, Node * next, PackedState next_state, Move move_to_next) {
 	
 	// Find positions in table, make sure already exist
-	PosIterator pos_i = positions.find(state);
+	PosIterator pos_i = positions.find(PackedState(state));
 	PosIterator next_i = positions.find(next_state);
 	if (pos_i == positions.end() || next_i == positions.end()) {
 		return false;
@@ -112,33 +114,22 @@ bool TableBase::AddLinkedSolved(BoardState state, uint8_t result, Node * next, B
 
 bool TableBase::AddUnmovesToFrontier(BoardState state) {
 	
-	bool orig_color = state.white_to_move;
+	// Generator and buffers for finding earlier positions
+	static MoveGenerator mgen;
+	static BoardComposite board;
+	static std::vector<Unmove> unmoves;
+	static std::vector<BoardState> earlier;
 	
-	// Board for finding moves
-	static Board unmoves_board;
-	unmoves_board.SetCurrent(state);
-	const MoveList * unmoves = unmoves_board.GetUnmoves();
+	// Add every legal earlier position with the same material (no uncaptures
+	// or unpromotions), since each table holds a single set of material;
+	// earlier positions that differ only in castling rights or en passant
+	// target are separate keys, and each is added
+	board.Init(state);
+	mgen.GetLegalUnmoves(&board, &unmoves, &earlier, board.GetMaterial());
 	
-	// Board for making moves
-	static Board make_board;
-	state.white_to_move = !state.white_to_move;
-	make_board.SetCurrent(state);
-	
-	// Iterate through unmoves
-	const Move * unmoves_i = unmoves->Begin();
-	const Move * unmoves_end = unmoves->End();
-	for (; unmoves_i != unmoves_end; unmoves_i++) {
-		if (make_board.Make(*unmoves_i)) {
-			// Check that the unmove is legal
-			// (i.e. the color that did not make the unmove is not in check
-			// before the move was made)
-			if (!make_board.InCheck(orig_color)) {
-				BoardState state_to_add = make_board.GetCurrent();
-				state_to_add.white_to_move = !state_to_add.white_to_move;
-				AddFrontier(state_to_add);
-			}
-			make_board.Unmake(1);
-		}
+	auto earlier_i = earlier.begin(), earlier_end = earlier.end();
+	for (; earlier_i != earlier_end; earlier_i++) {
+		AddFrontier(*earlier_i);
 	}
 	
 	return true;
@@ -168,7 +159,7 @@ void TableBase::Expand() {
 		auto frontier_i = frontier.begin(), frontier_end = frontier.end();
 		for (; frontier_i != frontier_end; frontier_i++) {
 			
-			BoardState state = (*frontier_i)->first;
+			BoardState state = (*frontier_i)->first.GetState();
 			Node * node = (*frontier_i)->second;
 			if (!node) continue;
 			
@@ -180,10 +171,11 @@ void TableBase::Expand() {
 			// Check whether there was a missed stalemate/checkmate
 			// Prevents error conditions later, and pre-generates moves
 			board.SetCurrent(state);
-			if (board.IsCheckmate()) {
+			GameStatus status = board.GetStatus();
+			if (status.IsCheckmate()) {
 				AddStaticallySolved(state, cond_win);
 			}
-			else if (board.IsStalemate()) {
+			else if (status.IsStalemate()) {
 				AddStaticallySolved(state, cond_draw);
 			}
 			
@@ -195,10 +187,7 @@ void TableBase::Expand() {
 			
 			// Filter through possible moves from this position
 			// If any win conditions are found, exit immediately
-			if (!node->move_cache.IsValid()) {
-				node->move_cache = *board.GetMoves();
-			}
-			const MoveList * moves = &node->move_cache;
+			const MoveList * moves = board.GetLegalMoves();
 			const Move * move_i = moves->Begin();
 			const Move * move_end = moves->End();
 			for (; move_i != move_end; move_i++) {
@@ -206,11 +195,8 @@ void TableBase::Expand() {
 					Node * next_node = NULL;
 					PosIterator next_i;
 					
-					// Verify that not moved into check
-					if (board.InCheck(state.white_to_move)) goto unmake;
-					
 					// Find position in solved
-					next_i = positions.find(board.GetCurrent());
+					next_i = positions.find(board.GetCurrentPacked());
 					if (next_i == positions.end()) {
 						any_undetermined = true;
 						goto unmake;
@@ -289,7 +275,7 @@ void TableBase::Optimize() {
 		PosIterator pos_end = positions.end();
 		for (; pos_i != pos_end; pos_i++) {
 			
-			BoardState state = pos_i->first;
+			BoardState state = pos_i->first.GetState();
 			Node * node = pos_i->second;
 			if (!node) {
 				n_not_optimal++;
@@ -314,10 +300,7 @@ void TableBase::Optimize() {
 				
 			// Iterate through moves to check child positions
 			board.SetCurrent(state);
-			if (!node->move_cache.IsValid()) {
-				node->move_cache = *board.GetMoves();
-			}
-			const MoveList * moves = &node->move_cache;
+			const MoveList * moves = board.GetLegalMoves();
 			const Move * move_i = moves->Begin();
 			const Move * move_end = moves->End();
 			for (; move_i != move_end; move_i++) {
@@ -326,11 +309,8 @@ void TableBase::Optimize() {
 					PosIterator next_i;
 					Node * next_node;
 					
-					// Verify that not moved into check
-					if (board.InCheck(state.white_to_move)) goto unmake;
-					
 					// Find position in solved
-					next_i = positions.find(board.GetCurrent());
+					next_i = positions.find(board.GetCurrentPacked());
 					if (next_i == positions.end()) {
 						n_not_optimal++;
 						goto unmake;
@@ -380,7 +360,7 @@ void TableBase::Optimize() {
 TableBase::Evaluation TableBase::Evaluate(BoardState state) {
 	Evaluation output;
 	
-	PosIterator pos_i = positions.find(state);
+	PosIterator pos_i = positions.find(PackedState(state));
 	if (pos_i == positions.end() || !pos_i->second) {
 		output.result = Evaluation::RESULT_UNDETERMINED;
 		return output;
@@ -395,6 +375,14 @@ TableBase::Evaluation TableBase::Evaluate(BoardState state) {
 	}
 }
 
+TableBase::Node::Status TableBase::GetStatus(BoardState state) {
+	PosIterator pos_i = positions.find(PackedState(state));
+	if (pos_i == positions.end() || !pos_i->second) {
+		return Node::STATUS_INVALID;
+	}
+	return (Node::Status)pos_i->second->status;
+}
+
 std::ostream & operator << (std::ostream & os, TableBase & tb) {
 	
 	// Count frontier/solved nodes
@@ -43,14 +43,13 @@ public:
 		Node * next;
 		Move move_to_next;
 		
-		MoveList move_cache;
-		
 		friend std::ostream & operator << (std::ostream & os, Node node);
 	} __attribute__((__packed__));
 	
 protected:
-	typedef std::map<BoardState, Node *>::iterator PosIterator;
-	std::map<BoardState, Node *> positions;
+	// Positions are keyed by their packed states to halve the size of the keys
+	typedef std::map<PackedState, Node *>::iterator PosIterator;
+	std::map<PackedState, Node *> positions;
 	std::vector<std::string> search_dirs;
 
 /*******************************************************************************
@@ -71,7 +70,7 @@ public:
 	bool AddStaticallySolved(BoardState state, uint8_t result);
 protected:
 	bool AddFrontier(BoardState state);
-	bool AddLinkedSolved(BoardState state, uint8_t result, Node * next, BoardState next_state, Move move_to_next);
+	bool AddLinkedSolved(BoardState state, uint8_t result, Node * next, PackedState next_state, Move move_to_next);
 	bool AddUnmovesToFrontier(BoardState state);
 	
 public:
@@ -83,6 +82,7 @@ public:
  */
 public:
 	Evaluation Evaluate(BoardState state);
+	Node::Status GetStatus(BoardState state);
 	Evaluation EvaluateFromFile(BoardState state);
 	std::vector<Evaluation> EvaluateSequence(BoardState state);
 	std::vector<Evaluation> EvaluateSequenceFromFile(BoardState state);
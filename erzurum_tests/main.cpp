@@ -6,7 +6,23 @@
 #include <iostream>
 #include <string.h>
 
+void Test_EnPassantFrontier() {
+	// Black just moved the king with white to move; before that, white may
+	// have played e2-e4, so the earlier position has an en passant target
+	BoardState solved, earlier, earlier_ep;
+	solved.InitFromFEN("4k3/8/8/8/4P3/8/8/K7 w - - 1 2");
+	earlier.InitFromFEN("3k4/8/8/8/4P3/8/8/K7 b - - 0 1");
+	earlier_ep.InitFromFEN("3k4/8/8/8/4P3/8/8/K7 b - e3 0 1");
+	
+	TableBase tb;
+	tb.AddStaticallySolved(solved, TableBase::Node::RESULT_DRAW);
+	std::cout << "Without en passant: " << (tb.GetStatus(earlier) == TableBase::Node::STATUS_FRONTIER ? "frontier" : "missing") << std::endl;
+	std::cout << "With en passant:    " << (tb.GetStatus(earlier_ep) == TableBase::Node::STATUS_FRONTIER ? "frontier" : "missing") << std::endl;
+}
+
 int main(int argc, char ** argv) {
+	Test_EnPassantFrontier();
+	
 	TableBase tb;
 	
 	std::cout << sizeof(Move) << std::endl;